@@ -0,0 +1,347 @@
+/* pn532_client.c - pn532_com.h/pn532_hf15.h API implemented by talking to pn532d
+ *
+ * Link this instead of pn532_com.c, the transports and pn532_hf15.c to use a
+ * reader owned by pn532d. Modules on top of the command layer work unchanged.
+ *
+ * Commands sent with pn532_send_command() are forwarded when the response is
+ * waited for, so command and response are one request to the daemon. hf15_*
+ * functions are single requests too and can't be interleaved with commands
+ * of other clients.
+ *
+ * Other clients may send commands between two requests, which breaks sequences
+ * that rely on reader state (selected target, MIFARE authentication, target
+ * mode). Such sequences have to be wrapped in pn532_lock()/pn532_unlock().
+ * mf_dump(), hf15_encode_tag()/hf15_encode_run() (per tag) and pn532_tgt_run()
+ * (per reader session) do this themselves; mf_auth() followed by
+ * mf_read_block()/mf_write_block() and ndef_open() followed by the other
+ * ndef_* calls need it from the caller.
+ *
+ * pn532d gives up on a response after its timeout (-T) and aborts the command,
+ * so commands waiting for a tag or reader (TgInitAsTarget, InListPassiveTarget
+ * with infinite retries) return -1 then instead of blocking the reader.
+ * pn532_tgt_run() sends TgInitAsTarget again in that case.
+ *
+ * Raw byte access (pn532_write/pn532_read/pn532_poll) is not available.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include "pn532_com.h"
+#include "pn532_hf15.h"
+#include "pn532d.h"
+
+typedef struct
+{
+    uint8_t *shm;
+    int pending;                    // pn532_send_command() waiting to be sent
+    uint16_t pending_len;
+    uint8_t pending_cmd[PN532D_MAX_DATA];
+} client_priv_t;
+
+/* Send request, wait for response, update pn532->result */
+static int call(pn532_t *pn532, uint16_t op, const uint8_t *data, size_t len, uint8_t *out, size_t out_len) {
+    pn532d_request_t req;
+    pn532d_response_t resp;
+    ssize_t n;
+
+    if (pn532->fd == -1 || len > sizeof(req.data)) return -1;
+
+    req.op = op;
+    req.len = len;
+    if (len) memcpy(req.data, data, len);
+    if (send(pn532->fd, &req, PN532D_REQUEST_HDR + len, MSG_NOSIGNAL) < 0) {
+        perror("pn532d send");
+        return -1;
+    }
+    if ((n = recv(pn532->fd, &resp, sizeof(resp), 0)) < (ssize_t)PN532D_RESPONSE_HDR) {
+        perror("pn532d recv");
+        return -1;
+    }
+
+    pn532->result = resp.result;
+    pn532->rf = resp.rf;
+    if (out) memcpy(out, resp.data, resp.len < out_len ? resp.len : out_len);
+    return resp.ret;
+}
+
+/* device selects the reader of the daemon, unknown names get the first one
+ * The daemon socket is $PN532D_SOCKET or PN532D_SOCKET
+ */
+int pn532_open(pn532_t *pn532, const char *device) {
+    const char *path = getenv("PN532D_SOCKET");
+    struct sockaddr_un addr = {AF_UNIX};
+    pn532d_request_t req;
+    pn532d_response_t resp;
+    client_priv_t *client;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {&req, 0};
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+    int shm_fd;
+
+    memset(pn532, 0, sizeof(*pn532));
+    pn532->fd = -1;
+    if (!path) path = PN532D_SOCKET;
+    if (!(client = calloc(1, sizeof(*client)))) return -1;
+
+    if ((pn532->fd = socket(AF_UNIX, SOCK_SEQPACKET, 0)) < 0) {
+        free(client);
+        return -1;
+    }
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    if (connect(pn532->fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        perror("Unable to connect to pn532d");
+        close(pn532->fd);
+        pn532->fd = -1;
+        free(client);
+        return -1;
+    }
+
+    req.op = PN532D_HELLO;
+    req.len = snprintf((char *)req.data, sizeof(req.data), "%s", device ? device : "");
+    iov.iov_len = PN532D_REQUEST_HDR + req.len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    // Shared memory for bulk transfers
+    if ((shm_fd = memfd_create("pn532d", 0)) >= 0) {
+        if (ftruncate(shm_fd, PN532D_SHM_SIZE) == 0 &&
+            (client->shm = mmap(NULL, PN532D_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0)) != MAP_FAILED) {
+            msg.msg_control = cbuf;
+            msg.msg_controllen = sizeof(cbuf);
+            cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(cmsg), &shm_fd, sizeof(int));
+        } else client->shm = NULL;
+    }
+
+    if (sendmsg(pn532->fd, &msg, MSG_NOSIGNAL) < 0 ||
+        recv(pn532->fd, &resp, sizeof(resp), 0) < (ssize_t)PN532D_RESPONSE_HDR || resp.ret) {
+        fprintf(stderr, "pn532d refused connection\n");
+        if (client->shm) munmap(client->shm, PN532D_SHM_SIZE);
+        if (shm_fd >= 0) close(shm_fd);
+        close(pn532->fd);
+        pn532->fd = -1;
+        free(client);
+        return -1;
+    }
+    if (shm_fd >= 0) close(shm_fd);
+
+    pn532->priv = client;
+    return 0;
+}
+
+int pn532_open_transport(pn532_t *pn532, const pn532_transport_t *transport, const char *device) {
+    return -1;
+}
+
+void pn532_close(pn532_t *pn532) {
+    client_priv_t *client = pn532->priv;
+
+    if (pn532->fd != -1) {
+        close(pn532->fd);
+        pn532->fd = -1;
+    }
+    if (client) {
+        if (client->shm) munmap(client->shm, PN532D_SHM_SIZE);
+        free(client);
+        pn532->priv = NULL;
+    }
+}
+
+int pn532_write(pn532_t *pn532, uint8_t *data, size_t len) {
+    return -1;
+}
+
+int pn532_read(pn532_t *pn532, uint8_t *buffer, size_t len) {
+    return -1;
+}
+
+int pn532_poll(pn532_t *pn532, int timeout_ms) {
+    return -1;
+}
+
+/* Reader is kept in normal mode by the daemon */
+int pn532_set_normal_mode(pn532_t *pn532) {
+    return 0;
+}
+
+int pn532_is_pn532killer(pn532_t *pn532) {
+    return call(pn532, PN532D_IS_PN532KILLER, NULL, 0, NULL, 0);
+}
+
+int pn532_send_command(pn532_t *pn532, uint8_t cmd, uint8_t *data, size_t data_len) {
+    client_priv_t *client = pn532->priv;
+
+    if (!client || data_len + 2 > sizeof(client->pending_cmd)) return -1;
+    client->pending_cmd[0] = cmd;
+    client->pending_cmd[1] = cmd;
+    if (data_len) memcpy(&client->pending_cmd[2], data, data_len);
+    client->pending_len = data_len + 2;
+    client->pending = 1;
+    return 0;
+}
+
+int pn532_wait_response(pn532_t *pn532, uint8_t cmd) {
+    client_priv_t *client = pn532->priv;
+
+    if (!client || !client->pending) return -1;
+    client->pending = 0;
+    client->pending_cmd[1] = cmd;
+    return call(pn532, PN532D_EXCHANGE, client->pending_cmd, client->pending_len, NULL, 0);
+}
+
+/* Done by pn532d itself, fails only if the daemon is gone */
+int pn532_abort(pn532_t *pn532) {
+    return pn532->fd == -1 ? -1 : 0;
+}
+
+int pn532_lock(pn532_t *pn532) {
+    return call(pn532, PN532D_LOCK, NULL, 0, NULL, 0);
+}
+
+int pn532_unlock(pn532_t *pn532) {
+    return call(pn532, PN532D_UNLOCK, NULL, 0, NULL, 0);
+}
+
+int pn532_read_response(pn532_t *pn532, pn532_result_t *response) {
+    client_priv_t *client = pn532->priv;
+    int ret;
+
+    if (!client || !client->pending) return -1;
+    if ((ret = pn532_wait_response(pn532, client->pending_cmd[0])) == 0 && response)
+        *response = pn532->result;
+    return ret;
+}
+
+/* HF15 */
+
+int hf15_read_block(pn532_t *pn532, uint8_t block_num, uint8_t *response, uint8_t response_len) {
+    uint8_t req[2] = {block_num, response_len};
+
+    return call(pn532, PN532D_HF15_READ_BLOCK, req, sizeof(req), response, response_len);
+}
+
+int hf15_read_blocks(pn532_t *pn532, uint8_t first_block, uint8_t count, uint8_t block_size, uint8_t *response) {
+    uint8_t req[3] = {first_block, count, block_size};
+
+    return call(pn532, PN532D_HF15_READ_BLOCKS, req, sizeof(req), response, count * block_size);
+}
+
+/* Result is passed back through shared memory */
+int hf15_dump(pn532_t *pn532, uint8_t first_block, unsigned int count, uint8_t block_size, uint8_t *buffer) {
+    client_priv_t *client = pn532->priv;
+    uint8_t req[4] = {first_block, count & 0xFF, (count >> 8) & 0xFF, block_size};
+    int ret;
+
+    if (!client || !client->shm || count * block_size > PN532D_SHM_SIZE) return PAR_ERR;
+    if ((ret = call(pn532, PN532D_HF15_DUMP, req, sizeof(req), NULL, 0)) == 0)
+        memcpy(buffer, client->shm, count * block_size);
+    return ret;
+}
+
+static int write_block(pn532_t *pn532, uint16_t op, uint8_t block_num, uint8_t *data, uint8_t len) {
+    uint8_t req[len + 1];
+
+    req[0] = block_num;
+    memcpy(&req[1], data, len);
+    return call(pn532, op, req, sizeof(req), NULL, 0);
+}
+
+int hf15_write_block(pn532_t *pn532, uint8_t block_num, uint8_t *data, uint8_t len) {
+    return write_block(pn532, PN532D_HF15_WRITE_BLOCK, block_num, data, len);
+}
+
+int hf15_write_block_verify(pn532_t *pn532, uint8_t block_num, uint8_t *data, uint8_t len) {
+    return write_block(pn532, PN532D_HF15_WRITE_BLOCK_VERIFY, block_num, data, len);
+}
+
+int hf15_scan(pn532_t *pn532, hf15_tag_scan *scan) {
+    return call(pn532, PN532D_HF15_SCAN, NULL, 0, (uint8_t *)scan, sizeof(*scan));
+}
+
+int hf15_info(pn532_t *pn532, hf15_tag_info *info) {
+    return call(pn532, PN532D_HF15_INFO, NULL, 0, (uint8_t *)info, sizeof(*info));
+}
+
+int hf15_set_gen1_uid(pn532_t *pn532, uint8_t *uid, uint8_t block_size) {
+    uint8_t req[9];
+
+    memcpy(req, uid, 8);
+    req[8] = block_size;
+    return call(pn532, PN532D_HF15_SET_GEN1_UID, req, sizeof(req), NULL, 0);
+}
+
+int hf15_set_gen2_uid(pn532_t *pn532, uint8_t *uid) {
+    return call(pn532, PN532D_HF15_SET_GEN2_UID, uid, 8, NULL, 0);
+}
+
+int hf15_set_gen2_config(pn532_t *pn532, uint8_t size, uint8_t adi, uint8_t dsfid, uint8_t ic_reference) {
+    uint8_t req[4] = {size, adi, dsfid, ic_reference};
+
+    return call(pn532, PN532D_HF15_SET_GEN2_CONFIG, req, sizeof(req), NULL, 0);
+}
+
+int hf15_raw(pn532_t *pn532, uint8_t *cmd_data, size_t cmd_len, int select_tag, int append_crc, int no_check_response) {
+    uint8_t req[cmd_len + 3];
+
+    req[0] = select_tag;
+    req[1] = append_crc;
+    req[2] = no_check_response;
+    memcpy(&req[3], cmd_data, cmd_len);
+    return call(pn532, PN532D_HF15_RAW, req, sizeof(req), NULL, 0);
+}
+
+int hf15_eset_uid(pn532_t *pn532, uint8_t slot, uint8_t *new_uid) {
+    uint8_t req[9];
+
+    req[0] = slot;
+    memcpy(&req[1], new_uid, 8);
+    return call(pn532, PN532D_HF15_ESET_UID, req, sizeof(req), NULL, 0);
+}
+
+int hf15_eset_block(pn532_t *pn532, uint8_t slot, int8_t block_index, uint8_t *block_data) {
+    uint8_t req[6];
+
+    req[0] = slot;
+    req[1] = block_index;
+    memcpy(&req[2], block_data, 4);
+    return call(pn532, PN532D_HF15_ESET_BLOCK, req, sizeof(req), NULL, 0);
+}
+
+/* Dump is passed through shared memory */
+int hf15_eset_dump(pn532_t *pn532, uint8_t slot, uint8_t *bin_data, size_t bin_len) {
+    client_priv_t *client = pn532->priv;
+    uint8_t req[3] = {slot, bin_len & 0xFF, (bin_len >> 8) & 0xFF};
+
+    if (!client || !client->shm || bin_len > PN532D_SHM_SIZE) return PAR_ERR;
+    memcpy(client->shm, bin_data, bin_len);
+    return call(pn532, PN532D_HF15_ESET_DUMP, req, sizeof(req), NULL, 0);
+}
+
+int hf15_eset_resv_eas_afi_dsfid(pn532_t *pn532, uint8_t slot, uint8_t resv, uint8_t eas, uint8_t afi, uint8_t dsfid) {
+    uint8_t req[5] = {slot, resv, eas, afi, dsfid};
+
+    return call(pn532, PN532D_HF15_ESET_RESV, req, sizeof(req), NULL, 0);
+}
+
+int hf15_eset_write_protect(pn532_t *pn532, uint8_t slot, uint8_t *data, size_t data_len) {
+    uint8_t req[data_len + 1];
+
+    req[0] = slot;
+    memcpy(&req[1], data, data_len);
+    return call(pn532, PN532D_HF15_ESET_WRITE_PROTECT, req, sizeof(req), NULL, 0);
+}
+
+int hf15_esave(pn532_t *pn532, uint8_t slot) {
+    return call(pn532, PN532D_HF15_ESAVE, &slot, 1, NULL, 0);
+}
@@ -2,11 +2,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <fcntl.h>
-#include <termios.h>
-#include <sys/ioctl.h>
 #include <errno.h>
 #include "pn532_com.h"
+#include "pn532_trace.h"
+#include "pn532_transport.h"
 
 
 typedef struct {
@@ -30,62 +29,53 @@ typedef struct {
 #define PN532_TFI_RECEIVE   0xD5
 #define PN532_ACK_FRAME    {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00}
 
-#define PN532_SERIAL_SPEED B115200
-
-/* Function to open serial port */
+/* Open device, the transport is selected by prefix:
+ *   spi:/dev/spidev0.0[@speed]   SPI via spidev
+ *   i2c:/dev/i2c-1               I2C via i2c-dev
+ *   loop:                        In-memory loopback, see pn532_loop_feed()
+ *   replay:trace.bin             Recorded trace, see pn532_replay_open()
+ *   /dev/ttyACM0                 Anything else is a serial port (HSU)
+ */
 int pn532_open(pn532_t *pn532, const char *device) {
-    struct termios options;
-    int flags;
-
-    pn532->fd = open(device, O_RDWR | O_NOCTTY);
-    if (pn532->fd == -1) {
-        perror("Unable to open serial port");
-        return -1;
+    static const struct {
+        const char *prefix;
+        const pn532_transport_t *transport;
+    } prefixes[] = {
+        {"spi:", &pn532_spi_transport},
+        {"i2c:", &pn532_i2c_transport},
+        {"loop:", &pn532_loop_transport},
+        {"replay:", &pn532_replay_transport},
+    };
+    int i;
+
+    for (i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+        if (!strncmp(device, prefixes[i].prefix, strlen(prefixes[i].prefix)))
+            return pn532_open_transport(pn532, prefixes[i].transport, device + strlen(prefixes[i].prefix));
     }
 
-    tcgetattr(pn532->fd, &options);
-
-    options.c_cflag = CS8 | CLOCAL | CREAD | HUPCL;
-    cfsetispeed(&options, PN532_SERIAL_SPEED);
-    cfsetospeed(&options, PN532_SERIAL_SPEED);
-
-    options.c_iflag = 0;
-    options.c_oflag = 0;
-    options.c_lflag = 0;
-    tcflush(pn532->fd, TCIFLUSH);
-
-    // We do blocking I/O
-    options.c_cc[VMIN] = 1;   // Must read at least 1 byte before returning
-    options.c_cc[VTIME] = 0;  // No timeout (wait indefinitely)
-
-    tcsetattr(pn532->fd, TCSANOW, &options);
-
-    // Set DTR and RTS
-//    flags = TIOCM_DTR;
-//    ioctl(pn532->fd, TIOCMBIS, &flags); // Enable DTR
-    flags = TIOCM_RTS;
-    ioctl(pn532->fd, TIOCMBIS, &flags); // Enable RTS
-
-    // Flush input buffer
-    tcflush(pn532->fd, TCIFLUSH);
-
-    flags = TIOCM_DTR;
-    ioctl(pn532->fd, TIOCMBIC, &flags); // Clear DTR
-    flags = TIOCM_RTS;
-    ioctl(pn532->fd, TIOCMBIC, &flags); // Clear RTS
+    return pn532_open_transport(pn532, &pn532_uart_transport, device);
+}
 
-    usleep(100000);
+int pn532_open_transport(pn532_t *pn532, const pn532_transport_t *transport, const char *device) {
+    int ret;
 
-    tcgetattr(pn532->fd, &options);
+    memset(&pn532->rf, 0, sizeof(pn532->rf));
+    pn532->trace = NULL;
+    pn532->fd = -1;
+    pn532->priv = NULL;
+    pn532->timeout_ms = -1;
+    pn532->transport = transport;
 
-    return 0;
+    if (ret = transport->open(pn532, device)) pn532->transport = NULL;
+    return ret;
 }
 
-/* Function to close serial port */
+/* Function to close device */
 void pn532_close(pn532_t *pn532) {
-    if (pn532->fd != -1) {
-        close(pn532->fd);
-        pn532->fd = -1;
+    pn532_trace_stop(pn532);
+    if (pn532->transport) {
+        pn532->transport->close(pn532);
+        pn532->transport = NULL;
     }
 }
 
@@ -105,7 +95,7 @@ int pn532_set_normal_mode(pn532_t *pn532)
     int ret;
     uint8_t cmd[14] = {0x55, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
-    if (ret = pn532_write(pn532, cmd, sizeof(cmd))) return ret;
+    if ((pn532->transport->flags & PN532_TR_WAKEUP) && (ret = pn532_write(pn532, cmd, sizeof(cmd)))) return ret;
     cmd[0] = 0x01;
     if (ret = pn532_send_command(pn532, SAMConfiguration, cmd, 1)) return ret;
     if (pn532_read(pn532, cmd, 1) < 1) return -1;
@@ -115,32 +105,33 @@ int pn532_set_normal_mode(pn532_t *pn532)
 
 /* Function to write data to PN532 */
 int pn532_write(pn532_t *pn532, uint8_t *data, size_t len) {
-    ssize_t written = write(pn532->fd, data, len);
-    if (written < 0) {
-        perror("Write error");
-        return -1;
-    }
+    if (pn532->transport->write(pn532, data, len) < 0) return -1;
+    if (pn532->trace) pn532_trace_record(pn532->trace, 0, data, len);
     return 0;
 }
 
-/* Function to read data from PN532 */
+/* Function to read data from PN532, returns less than len bytes on timeout */
 int pn532_read(pn532_t *pn532, uint8_t *buffer, size_t len) {
     ssize_t read_bytes = 0, ret;
 
     do {
-        ret = read(pn532->fd, buffer+read_bytes, len);
-        if (ret < 0) {
-            perror("Read error");
-            return -1;
-        }
+        if (pn532->timeout_ms >= 0 && (ret = pn532->transport->poll(pn532, pn532->timeout_ms)) <= 0)
+            return ret < 0 ? -1 : (int)read_bytes;
+        ret = pn532->transport->read(pn532, buffer+read_bytes, len-read_bytes);
+        if (ret < 0) return -1;
+        if (pn532->trace && ret) pn532_trace_record(pn532->trace, PN532_TRACE_RX, buffer+read_bytes, ret);
         read_bytes += ret;
     } while (ret && read_bytes < len);
     return (int)read_bytes;
 }
 
-/* Function to send command and get response */
-int pn532_send_command(pn532_t *pn532, uint8_t cmd, uint8_t *data, size_t data_len) {
-    uint8_t packet[data_len + 10];
+/* Wait until data can be read, 1 - Data available, 0 - Timeout */
+int pn532_poll(pn532_t *pn532, int timeout_ms) {
+    return pn532->transport->poll(pn532, timeout_ms);
+}
+
+/* Build a normal information frame, packet must hold data_len + 9 bytes */
+size_t pn532_build_frame(uint8_t tfi, uint8_t cmd, const uint8_t *data, size_t data_len, uint8_t *packet) {
     uint8_t checksum, len_byte;
     size_t idx = 0, i;
 
@@ -152,10 +143,10 @@ int pn532_send_command(pn532_t *pn532, uint8_t cmd, uint8_t *data, size_t data_l
     packet[idx++] = len_byte;
     packet[idx++] = ~len_byte + 1;
 
-    packet[idx++] = PN532_HOSTTOPN532;
+    packet[idx++] = tfi;
     packet[idx++] = cmd;
 
-    checksum = PN532_HOSTTOPN532 + cmd;
+    checksum = tfi + cmd;
     for (i = 0; i < data_len; i++) {
         packet[idx++] = data[i];
         checksum += data[i];
@@ -164,6 +155,32 @@ int pn532_send_command(pn532_t *pn532, uint8_t cmd, uint8_t *data, size_t data_l
     packet[idx++] = ~checksum + 1;
     packet[idx++] = PN532_POSTAMBLE;
 
+    return idx;
+}
+
+/* Length of the frame at the start of buffer including preamble/postamble,
+ * 0 if buffer does not contain the frame header yet
+ */
+size_t pn532_frame_length(const uint8_t *buffer, size_t len) {
+    size_t i;
+
+    for (i = 0; i + 4 <= len; i++) {
+        if (buffer[i] != PN532_STARTCODE1 || buffer[i+1] != PN532_STARTCODE2) continue;
+        // ACK (LEN 0x00, LCS 0xFF) and NACK (LEN 0xFF, LCS 0x00) only have a postamble
+        if ((buffer[i+2] == 0x00 && buffer[i+3] == 0xFF) || (buffer[i+2] == 0xFF && buffer[i+3] == 0x00))
+            return i + 5;
+        return i + 4 + buffer[i+2] + 2;
+    }
+
+    return 0;
+}
+
+/* Function to send command and get response */
+int pn532_send_command(pn532_t *pn532, uint8_t cmd, uint8_t *data, size_t data_len) {
+    uint8_t packet[data_len + 10];
+    size_t idx;
+
+    idx = pn532_build_frame(PN532_HOSTTOPN532, cmd, data, data_len, packet);
     if (pn532_write(pn532, packet, idx) < 0) return -1;
 
     return 0;
@@ -171,7 +188,7 @@ int pn532_send_command(pn532_t *pn532, uint8_t cmd, uint8_t *data, size_t data_l
 
 // response should be uint8_t buffer[260];
 //  0 Success
-// -1 Read error
+// -1 Read error or timeout (pn532->timeout_ms)
 // -2 
 // -3 Length checksum error
 // -4 Data checksum error
@@ -198,7 +215,7 @@ int pn532_read_response(pn532_t *pn532, pn532_result_t *response)
     if (pn532_read(pn532, &frame.length_checksum, frame.length+1) != frame.length+1)
         return -1;
 
-    if (frame.length && (frame.length + frame.length_checksum) & 0xFF  != 0) {
+    if (frame.length && ((frame.length + frame.length_checksum) & 0xFF) != 0) {
         return -3;    // Length checksum error
     }
 
@@ -211,7 +228,7 @@ int pn532_read_response(pn532_t *pn532, pn532_result_t *response)
         if (pn532_read(pn532, &frame.data_checksum, 1) != 1)
             return -1;
 
-        if ((frame.data_checksum + data_checksum) & 0xFF != 0)
+        if (((frame.data_checksum + data_checksum) & 0xFF) != 0)
             return -4; // Data checksum error
     }
 
@@ -242,6 +259,30 @@ int pn532_read_response(pn532_t *pn532, pn532_result_t *response)
     return 0;
 }
 
+/* Abort the command in progress (ACK from host) and drop what is left of its response */
+int pn532_abort(pn532_t *pn532)
+{
+    uint8_t ack[] = PN532_ACK_FRAME, buf[64];
+
+    if (pn532_write(pn532, ack, sizeof(ack))) return -1;
+    while (pn532->transport->poll(pn532, 10) > 0)
+        if (pn532->transport->read(pn532, buf, sizeof(buf)) <= 0) break;
+    return 0;
+}
+
+/* Exclusive use of the reader for a sequence of commands, only needed
+ * through pn532d (see pn532_client.c), a directly opened reader is exclusive
+ */
+int pn532_lock(pn532_t *pn532)
+{
+    return 0;
+}
+
+int pn532_unlock(pn532_t *pn532)
+{
+    return 0;
+}
+
 int pn532_wait_response(pn532_t *pn532, uint8_t cmd)
 {
     int ret;
@@ -253,18 +294,3 @@ int pn532_wait_response(pn532_t *pn532, uint8_t cmd)
 
     return ret;
 }
-
-char *pn532_strerror(int ret)
-{
-    switch (ret)
-    {
-    case  0: return "Success";
-    case -1: return "Read/Write error";
-    case -3: return "Length checksum error";
-    case -4: return "Data checksum error";
-    case -5: return "Postamble error";
-    case -6: return "Data frame TFI error";
-    case -7: return "Data frame length error";
-    default: return "Unknown error";
-    }
-}
@@ -80,18 +80,64 @@ typedef struct
     uint8_t data[255];
 } pn532_result_t;
 
+/* RFConfiguration items last sent to the PN532, see pn532_rf.c */
+typedef struct
+{
+    uint16_t valid;             // Bitmask of (1 << CfgItem) for items below
+    uint8_t field;
+    uint8_t timings[3];
+    uint8_t max_rty_com;
+    uint8_t max_retries[3];
+    uint8_t analog_106a[11];
+    uint8_t analog_212_424[8];
+    uint8_t analog_typeb[3];
+    uint8_t analog_iso14443_4[9];
+} pn532_rfcfg_t;
+
+typedef struct pn532_transport pn532_transport_t;
+
 typedef struct {
     int fd;
     pn532_result_t result;
+    pn532_rfcfg_t rf;
+    struct pn532_trace *trace;      // Wire trace recorder, see pn532_trace.c
+    const pn532_transport_t *transport;
+    void *priv;                     // Transport specific state
+    int timeout_ms;                 // Max wait for response bytes, -1 = forever (default)
 } pn532_t;
 
+#define PN532_TR_WAKEUP     0x01    // Needs 0x55 wakeup preamble (HSU)
+
+/* Transport backend, see pn532_transport.h
+ * read may return less than len bytes, 0 if nothing more will arrive
+ * poll returns 1 if data can be read, 0 on timeout (timeout_ms < 0 waits forever)
+ */
+struct pn532_transport
+{
+    const char *name;
+    int flags;
+    int (*open)(pn532_t *pn532, const char *device);
+    int (*write)(pn532_t *pn532, const uint8_t *data, size_t len);
+    int (*read)(pn532_t *pn532, uint8_t *buffer, size_t len);
+    int (*poll)(pn532_t *pn532, int timeout_ms);
+    void (*close)(pn532_t *pn532);
+};
+
 int pn532_open(pn532_t *pn532, const char *device);
+int pn532_open_transport(pn532_t *pn532, const pn532_transport_t *transport, const char *device);
+int pn532_poll(pn532_t *pn532, int timeout_ms);
+size_t pn532_build_frame(uint8_t tfi, uint8_t cmd, const uint8_t *data, size_t data_len, uint8_t *packet);
+size_t pn532_frame_length(const uint8_t *buffer, size_t len);
 void pn532_close(pn532_t *pn532);
 int pn532_write(pn532_t *pn532, uint8_t *data, size_t len);
 int pn532_read(pn532_t *pn532, uint8_t *buffer, size_t len);
 int pn532_send_command(pn532_t *pn532, uint8_t cmd, uint8_t *data, size_t data_len);
 int pn532_wait_response(pn532_t *pn532, uint8_t cmd);
 int pn532_read_response(pn532_t *pn532, pn532_result_t *response);
+int pn532_abort(pn532_t *pn532);
+int pn532_lock(pn532_t *pn532);
+int pn532_unlock(pn532_t *pn532);
 int pn532_is_pn532killer(pn532_t *pn532);
 int pn532_set_normal_mode(pn532_t *pn532);
 char *pn532_strerror(int ret);
+int pn532_result_data(pn532_t *pn532, uint8_t *data, size_t len);
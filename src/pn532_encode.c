@@ -0,0 +1,249 @@
+/* pn532_encode.c - Batch encoding of HF15 tags from a template image
+ *
+ * Keeps the reader session open and loops over:
+ *   wait for tag -> personalize image -> set UID -> write -> verify -> log -> wait for removal
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "pn532_com.h"
+#include "pn532_hf15.h"
+#include "pn532_encode.h"
+
+#define ENCODE_POLL_MS          50
+#define ENCODE_REMOVAL_SCANS    2
+
+static unsigned long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* 1 - Tag present, 0 - No tag, <0 - Communication error */
+static int tag_present(pn532_t *pn532, hf15_tag_scan *scan)
+{
+    int ret;
+
+    memset(scan, 0, sizeof(*scan));
+    if ((ret = hf15_scan(pn532, scan)) < 0) return ret;
+    return ret == 0 && pn532->result.len >= sizeof(*scan) && scan->tagType;
+}
+
+// 0 - Tag found
+// 1 - Stopped
+int hf15_wait_tag(pn532_t *pn532, hf15_tag_scan *scan, unsigned int poll_ms, volatile int *stop)
+{
+    int ret;
+
+    if (!poll_ms) poll_ms = ENCODE_POLL_MS;
+    while (!stop || !*stop) {
+        if ((ret = tag_present(pn532, scan)) < 0) return ret;
+        if (ret) return 0;
+        usleep(poll_ms * 1000);
+    }
+
+    return 1;
+}
+
+// scan must contain the tag currently on the reader
+// 0 - Tag removed
+// 1 - Stopped
+// 2 - A different tag showed up, scan has been updated
+int hf15_wait_removal(pn532_t *pn532, hf15_tag_scan *scan, unsigned int poll_ms, unsigned int empty_scans, volatile int *stop)
+{
+    hf15_tag_scan cur;
+    unsigned int empty = 0;
+    int ret;
+
+    if (!poll_ms) poll_ms = ENCODE_POLL_MS;
+    if (!empty_scans) empty_scans = ENCODE_REMOVAL_SCANS;
+    while (!stop || !*stop) {
+        if ((ret = tag_present(pn532, &cur)) < 0) return ret;
+        if (!ret) {
+            if (++empty >= empty_scans) return 0;
+        } else {
+            if (memcmp(cur.uid, scan->uid, sizeof(cur.uid))) {
+                memcpy(scan, &cur, sizeof(cur));
+                return 2;
+            }
+            empty = 0;
+        }
+        usleep(poll_ms * 1000);
+    }
+
+    return 1;
+}
+
+static void put_be(uint8_t *dst, uint8_t len, uint64_t value)
+{
+    while (len--) {
+        dst[len] = value & 0xFF;
+        value >>= 8;
+    }
+}
+
+static int verify_blocks(pn532_t *pn532, hf15_encode_job_t *job, uint8_t *image, uint8_t *bad)
+{
+    uint8_t buffer[job->blocks * job->block_size];
+    unsigned int block;
+    int ret, nbad = 0;
+
+    if ((ret = hf15_dump(pn532, 0, job->blocks, job->block_size, buffer))) return ret;
+    for (block = 0; block < job->blocks; block++) {
+        bad[block] = memcmp(&buffer[block * job->block_size], &image[block * job->block_size], job->block_size) != 0;
+        nbad += bad[block];
+    }
+
+    return nbad ? 2 : 0;
+}
+
+static int write_tag(pn532_t *pn532, hf15_encode_job_t *job, unsigned int index, uint8_t *uid, hf15_encode_stats_t *stats)
+{
+    uint8_t image[job->blocks * job->block_size];
+    uint8_t bad[job->blocks];
+    hf15_tag_scan scan;
+    unsigned int block, retry;
+    uint64_t serial = job->serial_start + index;
+    int ret;
+
+    memcpy(image, job->image, sizeof(image));
+    if (job->serial_block >= 0)
+        put_be(&image[job->serial_block * job->block_size + job->serial_offset], job->serial_len, serial);
+    if (job->set_uid) {
+        memcpy(uid, job->uid, sizeof(job->uid));
+        put_be(&uid[sizeof(job->uid) - job->uid_serial_len], job->uid_serial_len, serial);
+    }
+    if (job->personalize && job->personalize(job, index, image, uid)) return 3;
+
+    if (job->set_uid) {
+        if ((ret = hf15_set_gen2_uid(pn532, uid))) return ret;
+        // Tag has to be selected again with its new UID
+        if ((ret = tag_present(pn532, &scan)) < 0) return ret;
+        if (!ret || memcmp(scan.uid, uid, sizeof(scan.uid))) return 2;
+    }
+
+    for (block = 0; block < job->blocks; block++) {
+        if ((ret = hf15_write_block(pn532, block, &image[block * job->block_size], job->block_size))) return ret;
+        if (stats) stats->blocks_written++;
+    }
+
+    for (retry = 0; (ret = verify_blocks(pn532, job, image, bad)) == 2 && retry < job->retries; retry++) {
+        for (block = 0; block < job->blocks; block++) {
+            if (!bad[block]) continue;
+            if ((ret = hf15_write_block(pn532, block, &image[block * job->block_size], job->block_size))) return ret;
+            if (stats) stats->blocks_rewritten++;
+        }
+    }
+
+    return ret;
+}
+
+/* One tag without interruption by other pn532d clients */
+static int encode_tag(pn532_t *pn532, hf15_encode_job_t *job, unsigned int index, uint8_t *uid, hf15_encode_stats_t *stats)
+{
+    int ret;
+
+    if (ret = pn532_lock(pn532)) return ret;
+    ret = write_tag(pn532, job, index, uid, stats);
+    pn532_unlock(pn532);
+    return ret;
+}
+
+static int check_job(hf15_encode_job_t *job)
+{
+    if (!job->image || !job->blocks || !job->block_size || job->block_size > 8) return PAR_ERR;
+    if (job->serial_block >= 0 &&
+        (!job->serial_len || job->serial_len > 8 ||
+         job->serial_block * job->block_size + job->serial_offset + job->serial_len > job->blocks * job->block_size))
+        return PAR_ERR;
+    if (job->set_uid && job->uid_serial_len > sizeof(job->uid)) return PAR_ERR;
+    return 0;
+}
+
+static void log_tag(hf15_encode_job_t *job, unsigned int index, uint8_t *uid, int ret, unsigned long ms)
+{
+    int i;
+
+    if (!job->log) return;
+    fprintf(job->log, "%u\t", index);
+    for (i = 0; i < 8; i++) fprintf(job->log, "%02X", uid[i]);
+    switch (ret)
+    {
+    case 0: fprintf(job->log, "\tOK"); break;
+    case 2: fprintf(job->log, "\tVERIFY FAILED"); break;
+    case 3: fprintf(job->log, "\tSKIPPED"); break;
+    default: fprintf(job->log, "\tFAILED (%d)", ret); break;
+    }
+    fprintf(job->log, "\t%lums\n", ms);
+    fflush(job->log);
+}
+
+/* Encode a single tag that is already on the reader
+ * uid receives the UID of the tag after encoding
+ *  0 - Success
+ *  1 - A command failed
+ *  2 - Verify failed
+ *  3 - Skipped by personalize callback
+ *  PAR_ERR - Invalid job
+ *  <0 - Communication error
+ */
+int hf15_encode_tag(pn532_t *pn532, hf15_encode_job_t *job, unsigned int index, uint8_t *uid, hf15_encode_stats_t *stats)
+{
+    int ret;
+
+    if (ret = check_job(job)) return ret;
+    return encode_tag(pn532, job, index, uid, stats);
+}
+
+/* Encode tags until job->count tags succeeded or job->stop is set
+ * Returns 0, PAR_ERR for an invalid job or a negative communication error
+ */
+int hf15_encode_run(pn532_t *pn532, hf15_encode_job_t *job, hf15_encode_stats_t *stats)
+{
+    hf15_encode_stats_t local;
+    hf15_tag_scan scan;
+    unsigned long start = 0, t0;
+    unsigned int index = 0;
+    uint8_t uid[8];
+    int ret, have_tag = 0;
+
+    if (ret = check_job(job)) return ret;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+
+    while (!job->stop && (!job->count || index < job->count)) {
+        if (!have_tag) {
+            if ((ret = hf15_wait_tag(pn532, &scan, job->poll_ms, &job->stop)) < 0) return ret;
+            if (ret) break;
+        }
+
+        t0 = now_ms();
+        if (!start) start = t0;
+        memcpy(uid, scan.uid, sizeof(uid));
+        ret = encode_tag(pn532, job, index, uid, stats);
+        if (ret == 0) stats->tags_ok++;
+        else if (ret == 3) stats->tags_skipped++;
+        else stats->tags_failed++;
+        log_tag(job, index, uid, ret, now_ms() - t0);
+        if (ret == 0) index++;
+
+        stats->encode_ms += now_ms() - t0;
+        stats->elapsed_ms = now_ms() - start;
+        if (stats->elapsed_ms)
+            stats->tags_per_minute = stats->tags_ok * 60000.0 / stats->elapsed_ms;
+
+        if (job->count && index >= job->count) break;
+
+        // Operator has to take the tag off, so we don't encode it twice.
+        // If setting the UID failed halfway, the tag may answer with either UID
+        if (ret == 0 || ret == 2) memcpy(scan.uid, uid, sizeof(uid));
+        if ((ret = hf15_wait_removal(pn532, &scan, job->poll_ms, job->removal_scans, &job->stop)) < 0) return ret;
+        have_tag = ret == 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+/* pn532_encode.h - Batch encoding of HF15 tags from a template image */
+#include <stdio.h>
+
+typedef struct hf15_encode_job hf15_encode_job_t;
+
+/* Called for each tag before it is written.
+ * image is a private copy of the template that may be modified,
+ * uid holds the UID to set (if set_uid) and may be modified as well.
+ * Return != 0 to leave the tag untouched, it is then reported as skipped.
+ */
+typedef int (*hf15_encode_cb)(hf15_encode_job_t *job, unsigned int index, uint8_t *image, uint8_t *uid);
+
+struct hf15_encode_job
+{
+    // Template
+    uint8_t *image;             // blocks * block_size bytes
+    uint8_t blocks;
+    uint8_t block_size;         // Usually 4
+
+    // Per tag serial number, stored big endian into the image
+    int serial_block;           // -1 = none
+    uint8_t serial_offset;      // Byte offset in serial_block
+    uint8_t serial_len;         // 1..8 bytes, may span multiple blocks
+    uint64_t serial_start;
+
+    // Per tag UID (Gen2 magic tags), lower uid_serial_len bytes get the serial number
+    int set_uid;
+    uint8_t uid[8];
+    uint8_t uid_serial_len;
+
+    hf15_encode_cb personalize; // Optional, called after serial/UID have been applied
+    void *ctx;
+
+    unsigned int count;         // Number of tags to encode, 0 = until stop is set
+    unsigned int poll_ms;       // Delay between scans while waiting, 0 = default
+    unsigned int removal_scans; // Consecutive empty scans counting as removal, 0 = default
+    unsigned int retries;       // Rewrites of mismatching blocks, 0 = none
+    volatile int stop;          // May be set from a signal handler
+    FILE *log;                  // Optional per tag result log
+};
+
+typedef struct
+{
+    unsigned int tags_ok;
+    unsigned int tags_failed;
+    unsigned int tags_skipped;
+    unsigned int blocks_written;
+    unsigned int blocks_rewritten;
+    unsigned long elapsed_ms;       // From first tag arrival to last tag done
+    unsigned long encode_ms;        // Sum of time spent on tags (without waiting)
+    double tags_per_minute;
+} hf15_encode_stats_t;
+
+int hf15_encode_run(pn532_t *pn532, hf15_encode_job_t *job, hf15_encode_stats_t *stats);
+int hf15_encode_tag(pn532_t *pn532, hf15_encode_job_t *job, unsigned int index, uint8_t *uid, hf15_encode_stats_t *stats);
+int hf15_wait_tag(pn532_t *pn532, hf15_tag_scan *scan, unsigned int poll_ms, volatile int *stop);
+int hf15_wait_removal(pn532_t *pn532, hf15_tag_scan *scan, unsigned int poll_ms, unsigned int empty_scans, volatile int *stop);
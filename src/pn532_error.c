@@ -0,0 +1,40 @@
+/* pn532_error.c - Error messages and result decoding, shared by pn532_com.c and pn532_client.c builds */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "pn532_com.h"
+
+char *pn532_strerror(int ret)
+{
+    switch (ret)
+    {
+    case  0: return "Success";
+    case -1: return "Read/Write error";
+    case -3: return "Length checksum error";
+    case -4: return "Data checksum error";
+    case -5: return "Postamble error";
+    case -6: return "Data frame TFI error";
+    case -7: return "Data frame length error";
+    default: return "Unknown error";
+    }
+}
+
+/* Copy the len data bytes of an InDataExchange/InCommunicateThru response to data
+ * Long frames have the status byte already stripped by pn532_read_response
+ * Returns -1 if the response has a different length or an error status
+ */
+int pn532_result_data(pn532_t *pn532, uint8_t *data, size_t len)
+{
+    pn532_result_t *result = &pn532->result;
+
+    if (result->len == len + 1 && result->data[0] == HF_TAG_OK) {
+        if (len) memcpy(data, &result->data[1], len);
+        return 0;
+    }
+    if (len && result->len == len && result->status == HF_TAG_OK) {
+        memcpy(data, result->data, len);
+        return 0;
+    }
+
+    return -1;
+}
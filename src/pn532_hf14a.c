@@ -0,0 +1,264 @@
+/* pn532_hf14a.c - ANSI C implementation of ISO14443A / MIFARE Classic commands */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "pn532_com.h"
+#include "pn532_hf14a.h"
+#include "pn532_rf.h"
+
+
+/* Map PN532 error codes (status byte of InDataExchange) to enum Status */
+int hf14a_status(uint8_t err) {
+    switch (err & 0x3F)
+    {
+    case 0x00: return HF_TAG_OK;
+    case 0x01: return HF_TAG_NO;        // Timeout, target did not answer
+    case 0x02: return HF_ERR_CRC;
+    case 0x03: return HF_ERR_PARITY;
+    case 0x04: return HF_COLLISION;     // Erroneous bit count during anticollision
+    case 0x06: return HF_COLLISION;     // Abnormal bit collision
+    case 0x14: return MF_ERR_AUTH;      // MIFARE authentication error
+    case 0x23: return HF_ERR_BCC;       // Wrong UID check byte
+    default:   return HF_ERR_STAT;
+    }
+}
+
+/* Send a MIFARE command to target 1 and copy expect bytes of the answer to response */
+static int mf_exchange(pn532_t *pn532, uint8_t *cmd, size_t cmd_len, uint8_t *response, size_t expect) {
+    int ret;
+
+    if (ret = pn532_send_command(pn532, InDataExchange, cmd, cmd_len)) return ret;
+    if (ret = pn532_wait_response(pn532, InDataExchange)) return ret;
+
+    if (pn532->result.len < 1) return HF_ERR_STAT;
+    if (pn532->result.status & 0x3F) return hf14a_status(pn532->result.status);
+
+    return pn532_result_data(pn532, response, expect) ? HF_ERR_STAT : HF_TAG_OK;
+}
+
+/* Scan for a ISO14443A card (106 kbps type A) */
+int hf14a_scan(pn532_t *pn532, hf14a_tag_info *info) {
+    uint8_t cmd[2] = {0x01, 0x00};
+    uint8_t *data = pn532->result.data;
+    int ret;
+
+    if (ret = pn532_send_command(pn532, InListPassiveTarget, cmd, sizeof(cmd))) return ret;
+    if (ret = pn532_wait_response(pn532, InListPassiveTarget)) return ret;
+
+    memset(info, 0, sizeof(*info));
+    // NbTg, Tg, SENS_RES[2], SEL_RES, NFCIDLength, NFCID1[], ATS[]
+    if (pn532->result.len < 6 || data[0] == 0) return HF_TAG_NO;
+    if (data[5] > sizeof(info->uid) || pn532->result.len < 6 + data[5]) return HF_ERR_STAT;
+
+    info->tg = data[1];
+    info->atqa[0] = data[2];
+    info->atqa[1] = data[3];
+    info->sak = data[4];
+    info->uid_len = data[5];
+    memcpy(info->uid, &data[6], info->uid_len);
+    if (pn532->result.len > 6 + info->uid_len) {
+        info->ats_len = pn532->result.len - 6 - info->uid_len;
+        if (info->ats_len > sizeof(info->ats)) info->ats_len = sizeof(info->ats);
+        memcpy(info->ats, &data[6 + info->uid_len], info->ats_len);
+    }
+
+    return HF_TAG_OK;
+}
+
+/* Number of sectors for the card type given by SAK */
+int mf_sector_count(uint8_t sak) {
+    switch (sak)
+    {
+    case 0x09: return 5;            // MIFARE Mini
+    case 0x10:
+    case 0x11: return 32;           // MIFARE Plus 2K in SL2
+    case 0x18:
+    case 0x38:
+    case 0x98: return 40;           // MIFARE Classic 4K
+    default:   return 16;           // MIFARE Classic 1K
+    }
+}
+
+/* Sectors 0-31 have 4 blocks, 32-39 have 16 blocks */
+int mf_sector_first_block(int sector) {
+    return sector < 32 ? sector * 4 : 128 + (sector - 32) * 16;
+}
+
+int mf_sector_blocks(int sector) {
+    return sector < 32 ? 4 : 16;
+}
+
+/* Authenticate block_num with key_type MF_KEY_A or MF_KEY_B
+ * After a failed authentication, the card has to be selected again with hf14a_scan()
+ */
+int mf_auth(pn532_t *pn532, hf14a_tag_info *tag, uint8_t block_num, uint8_t key_type, const uint8_t *key) {
+    uint8_t cmd[13];
+
+    if (tag->uid_len < 4) return PAR_ERR;
+
+    cmd[0] = 0x01;
+    cmd[1] = key_type;
+    cmd[2] = block_num;
+    memcpy(&cmd[3], key, 6);
+    memcpy(&cmd[9], &tag->uid[tag->uid_len - 4], 4);
+
+    return mf_exchange(pn532, cmd, sizeof(cmd), NULL, 0);
+}
+
+/* Read single block, sector must be authenticated */
+int mf_read_block(pn532_t *pn532, uint8_t block_num, uint8_t *data) {
+    uint8_t cmd[3] = {0x01, 0x30, 0x00};
+
+    cmd[2] = block_num;
+    return mf_exchange(pn532, cmd, sizeof(cmd), data, MF_BLOCK_SIZE);
+}
+
+/* Write single block, sector must be authenticated */
+int mf_write_block(pn532_t *pn532, uint8_t block_num, uint8_t *data) {
+    uint8_t cmd[3 + MF_BLOCK_SIZE];
+
+    cmd[0] = 0x01;
+    cmd[1] = 0xA0;
+    cmd[2] = block_num;
+    memcpy(&cmd[3], data, MF_BLOCK_SIZE);
+    return mf_exchange(pn532, cmd, sizeof(cmd), NULL, 0);
+}
+
+/* Select the card again after a failed command has halted it */
+static int reselect(pn532_t *pn532, hf14a_tag_info *tag) {
+    hf14a_tag_info cur;
+    int ret;
+
+    if (ret = hf14a_scan(pn532, &cur)) return ret;
+    if (cur.uid_len != tag->uid_len || memcmp(cur.uid, tag->uid, tag->uid_len)) return HF_TAG_NO;
+    return HF_TAG_OK;
+}
+
+/* Try keys on a sector, cached and last successful key first.
+ * *found receives the key index or -1, the sector is authenticated if found
+ */
+static int find_key(pn532_t *pn532, hf14a_tag_info *tag, int sector, uint8_t key_type,
+                    const uint8_t (*keys)[6], size_t nkeys, int cached, int last, mf_dump_info *info, int *found) {
+    int block = mf_sector_first_block(sector);
+    int i, k, ret;
+
+    *found = -1;
+    for (i = -2; i < (int)nkeys; i++) {
+        k = i == -2 ? cached : i == -1 ? last : i;
+        if (k < 0 || k >= (int)nkeys) continue;
+        if (i == -1 && k == cached) continue;
+        if (i >= 0 && (k == cached || k == last)) continue;
+
+        info->auths++;
+        ret = mf_auth(pn532, tag, block, key_type, keys[k]);
+        if (ret == HF_TAG_OK) {
+            *found = k;
+            return 0;
+        }
+        if (ret < 0 || ret == PAR_ERR) return ret;
+        if (ret = reselect(pn532, tag)) return ret;
+    }
+
+    return 0;
+}
+
+/* Read all blocks of an authenticated sector that have not been read yet
+ * Returns number of blocks that failed, the card is halted then
+ */
+static int read_sector(pn532_t *pn532, hf14a_tag_info *tag, int sector, uint8_t *dump, mf_dump_info *info) {
+    int first = mf_sector_first_block(sector), n = mf_sector_blocks(sector);
+    int block, failed = 0, ret;
+
+    for (block = first; block < first + n; block++) {
+        if (info->block_ok[block]) continue;
+        ret = mf_read_block(pn532, block, &dump[block * MF_BLOCK_SIZE]);
+        if (ret < 0) return ret;
+        if (ret == HF_TAG_OK) {
+            info->block_ok[block] = 1;
+            continue;
+        }
+        // A NAKed read halts the card, remaining blocks need new authentication
+        failed = first + n - block;
+        break;
+    }
+
+    return failed;
+}
+
+static int dump_card(pn532_t *pn532, hf14a_tag_info *tag, const uint8_t (*keys)[6], size_t nkeys, uint8_t *dump, mf_dump_info *info) {
+    int sector, first, trailer, block, missing = 0;
+    int ka, kb, last_a = -1, last_b = -1, halted, ret;
+
+    if (info->uid_len != tag->uid_len || memcmp(info->uid, tag->uid, tag->uid_len)) {
+        memset(info, 0, sizeof(*info));
+        memcpy(info->uid, tag->uid, tag->uid_len);
+        info->uid_len = tag->uid_len;
+        for (sector = 0; sector < MF_MAX_SECTORS; sector++) info->key_a[sector] = info->key_b[sector] = -1;
+    }
+    info->sectors = mf_sector_count(tag->sak);
+    info->auths = 0;
+    memset(info->block_ok, 0, sizeof(info->block_ok));
+
+    for (sector = 0; sector < info->sectors; sector++) {
+        first = mf_sector_first_block(sector);
+        trailer = first + mf_sector_blocks(sector) - 1;
+
+        halted = 0;
+
+        if (ret = find_key(pn532, tag, sector, MF_KEY_A, keys, nkeys, info->key_a[sector], last_a, info, &ka)) return ret;
+        info->key_a[sector] = ka;
+        if (ka >= 0) {
+            last_a = ka;
+            if ((halted = read_sector(pn532, tag, sector, dump, info)) < 0) return halted;
+        }
+
+        for (block = first; block <= trailer && info->block_ok[block]; block++);
+        if (block <= trailer) {
+            // Switching from key A to key B requires a new selection
+            if (ka >= 0 && (ret = reselect(pn532, tag))) return ret;
+            if (ret = find_key(pn532, tag, sector, MF_KEY_B, keys, nkeys, info->key_b[sector], last_b, info, &kb)) return ret;
+            info->key_b[sector] = kb;
+            halted = 0;
+            if (kb >= 0) {
+                last_b = kb;
+                if ((halted = read_sector(pn532, tag, sector, dump, info)) < 0) return halted;
+            }
+        }
+        if (halted && (ret = reselect(pn532, tag))) return ret;
+
+        // Keys are never readable, fill in what we know
+        if (info->block_ok[trailer]) {
+            if (info->key_a[sector] >= 0) memcpy(&dump[trailer * MF_BLOCK_SIZE], keys[info->key_a[sector]], 6);
+            if (info->key_b[sector] >= 0) memcpy(&dump[trailer * MF_BLOCK_SIZE + 10], keys[info->key_b[sector]], 6);
+        }
+
+        for (block = first; block <= trailer; block++) missing += !info->block_ok[block];
+    }
+
+    return missing ? MF_DUMP_PARTIAL : 0;
+}
+
+/* Dump a MIFARE Classic card
+ * dump must hold mf_sector_count() sectors (max MF_MAX_BLOCKS * MF_BLOCK_SIZE bytes).
+ * Each sector is authenticated once per key type. Key A is tried first, key B only
+ * if some blocks could not be read with key A. Keys found are stored into the sector
+ * trailers of the dump. Passive activation is limited to MF_DUMP_RETRIES during the
+ * dump, so reselecting a card that left does not wait forever.
+ *  0 - All blocks read
+ *  MF_DUMP_PARTIAL - Some blocks could not be read, see info->block_ok
+ *  HF_TAG_NO - Card left the field
+ */
+int mf_dump(pn532_t *pn532, hf14a_tag_info *tag, const uint8_t (*keys)[6], size_t nkeys, uint8_t *dump, mf_dump_info *info) {
+    uint8_t retries[3] = {RF_RETRY_FOREVER, 0x01, RF_RETRY_FOREVER};     // PN532 defaults
+    int ret;
+
+    if (pn532->rf.valid & (1 << RfCfgMaxRetries)) memcpy(retries, pn532->rf.max_retries, sizeof(retries));
+
+    // Authentication must not be interrupted by other pn532d clients
+    if (ret = pn532_lock(pn532)) return ret;
+    if (!(ret = pn532_rf_max_retries(pn532, retries[0], retries[1], MF_DUMP_RETRIES)))
+        ret = dump_card(pn532, tag, keys, nkeys, dump, info);
+    pn532_rf_max_retries(pn532, retries[0], retries[1], retries[2]);
+    pn532_unlock(pn532);
+    return ret;
+}
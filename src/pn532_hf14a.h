@@ -0,0 +1,44 @@
+/* pn532_hf14a.h - ISO14443A / MIFARE Classic commands */
+
+#define MF_KEY_A        0x60
+#define MF_KEY_B        0x61
+#define MF_BLOCK_SIZE   16
+#define MF_MAX_SECTORS  40
+#define MF_MAX_BLOCKS   256
+#define MF_DUMP_PARTIAL 0x10    // mf_dump(): some blocks could not be read
+#define MF_DUMP_RETRIES 0x02    // mf_dump(): passive activation retries while reselecting
+
+typedef struct
+{
+    uint8_t tg;
+    uint8_t atqa[2];
+    uint8_t sak;
+    uint8_t uid_len;
+    uint8_t uid[10];
+    uint8_t ats_len;
+    uint8_t ats[64];
+} hf14a_tag_info;
+
+/* Result of mf_dump(), pass it in again for the same card to try the keys found last time first */
+typedef struct
+{
+    uint8_t uid[10];
+    uint8_t uid_len;
+    uint8_t sectors;
+    int16_t key_a[MF_MAX_SECTORS];      // Index into key list, -1 = unknown
+    int16_t key_b[MF_MAX_SECTORS];
+    uint8_t block_ok[MF_MAX_BLOCKS];    // Block has been read
+    unsigned int auths;                 // Authentication attempts
+} mf_dump_info;
+
+int hf14a_scan(pn532_t *pn532, hf14a_tag_info *info);
+int hf14a_status(uint8_t err);
+
+int mf_sector_count(uint8_t sak);
+int mf_sector_first_block(int sector);
+int mf_sector_blocks(int sector);
+
+int mf_auth(pn532_t *pn532, hf14a_tag_info *tag, uint8_t block_num, uint8_t key_type, const uint8_t *key);
+int mf_read_block(pn532_t *pn532, uint8_t block_num, uint8_t *data);
+int mf_write_block(pn532_t *pn532, uint8_t block_num, uint8_t *data);
+int mf_dump(pn532_t *pn532, hf14a_tag_info *tag, const uint8_t (*keys)[6], size_t nkeys, uint8_t *dump, mf_dump_info *info);
@@ -19,13 +19,46 @@ int hf15_read_block(pn532_t *pn532, uint8_t block_num, uint8_t *response, uint8_
     if (ret = pn532_send_command(pn532, InDataExchange, cmd, 3)) return ret;
     if (ret = pn532_wait_response(pn532, InDataExchange)) return ret;
 
-    if (pn532->result.len == 5 && pn532->result.data[0] == HF_TAG_OK)
-    {
-        memcpy(response, &pn532->result.data[1], pn532->result.len-1);
-        return 0;
+    return pn532_result_data(pn532, response, response_len);
+}
+
+/* Read multiple blocks with a single ISO15693 Read Multiple Blocks command
+ * response must hold count * block_size bytes
+ */
+int hf15_read_blocks(pn532_t *pn532, uint8_t first_block, uint8_t count, uint8_t block_size, uint8_t *response) {
+    uint8_t cmd[4] = {0x01, 0x23, 0x00, 0x00};
+    size_t expected = (size_t)count * block_size;
+    int ret;
+
+    if (!count || expected > sizeof(pn532->result.data) - 1) return PAR_ERR;
+
+    cmd[2] = first_block;
+    cmd[3] = count - 1;
+    if (ret = pn532_send_command(pn532, InDataExchange, cmd, sizeof(cmd))) return ret;
+    if (ret = pn532_wait_response(pn532, InDataExchange)) return ret;
+
+    return pn532_result_data(pn532, response, expected);
+}
+
+/* Read count blocks starting at first_block into buffer, HF15_READ_BATCH blocks per command
+ * Falls back to Read Single Block for tags without Read Multiple Blocks
+ */
+int hf15_dump(pn532_t *pn532, uint8_t first_block, unsigned int count, uint8_t block_size, uint8_t *buffer) {
+    unsigned int block, n, i;
+    int ret, single = 0;
+
+    for (block = 0; block < count; block += n) {
+        n = count - block;
+        if (n > HF15_READ_BATCH) n = HF15_READ_BATCH;
+        ret = single || n == 1 ? 1 : hf15_read_blocks(pn532, first_block + block, n, block_size, buffer + block * block_size);
+        if (!ret) continue;
+
+        for (i = block; i < block + n; i++)
+            if (ret = hf15_read_block(pn532, first_block + i, buffer + i * block_size, block_size)) return ret;
+        if (n > 1) single = 1;
     }
 
-    return -1;
+    return 0;
 }
 
 /* Write single block */
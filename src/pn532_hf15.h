@@ -1,3 +1,5 @@
+#define HF15_READ_BATCH     16  // Blocks per Read Multiple Blocks command in hf15_dump()
+
 #pragma pack(1)
 
 typedef struct
@@ -22,6 +24,8 @@ typedef struct
 #pragma pack()
 
 int hf15_read_block(pn532_t *pn532, uint8_t block_num, uint8_t *response, uint8_t response_len);
+int hf15_read_blocks(pn532_t *pn532, uint8_t first_block, uint8_t count, uint8_t block_size, uint8_t *response);
+int hf15_dump(pn532_t *pn532, uint8_t first_block, unsigned int count, uint8_t block_size, uint8_t *buffer);
 int hf15_write_block(pn532_t *pn532, uint8_t block_num, uint8_t *data, uint8_t len);
 int hf15_write_block_verify(pn532_t *pn532, uint8_t block_num, uint8_t *data, uint8_t len);
 int hf15_scan(pn532_t *pn532, hf15_tag_scan *scan);
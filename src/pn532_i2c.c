@@ -0,0 +1,115 @@
+/* pn532_i2c.c - I2C transport via i2c-dev
+ *
+ * Every read from the PN532 starts with a status byte (bit 0 = ready).
+ * The PN532 sends the whole response frame on each read, so once it is ready
+ * the frame is read in one transfer and handed out from a buffer.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+#include "pn532_com.h"
+#include "pn532_transport.h"
+
+#define PN532_I2C_ADDRESS     0x24
+#define PN532_I2C_READY       0x01
+
+typedef struct
+{
+    uint8_t buf[PN532_FRAME_MAX + 1];   // Status byte + frame
+    size_t pos;
+    size_t len;
+} i2c_priv_t;
+
+static int i2c_open(pn532_t *pn532, const char *device) {
+    i2c_priv_t *i2c;
+
+    if (!(i2c = calloc(1, sizeof(*i2c)))) return -1;
+
+    if ((pn532->fd = open(device, O_RDWR)) == -1) {
+        perror("Unable to open I2C device");
+        free(i2c);
+        return -1;
+    }
+    if (ioctl(pn532->fd, I2C_SLAVE, PN532_I2C_ADDRESS) < 0) {
+        perror("Unable to set I2C address");
+        close(pn532->fd);
+        pn532->fd = -1;
+        free(i2c);
+        return -1;
+    }
+
+    pn532->priv = i2c;
+    return 0;
+}
+
+static int i2c_write(pn532_t *pn532, const uint8_t *data, size_t len) {
+    if (write(pn532->fd, data, len) != (ssize_t)len) {
+        perror("I2C write error");
+        return -1;
+    }
+    return 0;
+}
+
+static int i2c_poll(pn532_t *pn532, int timeout_ms) {
+    i2c_priv_t *i2c = pn532->priv;
+    struct timespec start, now;
+    uint8_t status;
+
+    if (i2c->pos < i2c->len) return 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        // The PN532 NAKs its address while busy, so a failed read just means not ready
+        if (read(pn532->fd, &status, 1) == 1 && (status & PN532_I2C_READY)) return 1;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (timeout_ms >= 0 &&
+            (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 >= timeout_ms)
+            return 0;
+        usleep(1000);
+    }
+}
+
+static int i2c_read(pn532_t *pn532, uint8_t *buffer, size_t len) {
+    i2c_priv_t *i2c = pn532->priv;
+    ssize_t ret;
+    size_t frame_len;
+
+    if (i2c->pos >= i2c->len) {
+        if ((ret = i2c_poll(pn532, -1)) <= 0) return ret;
+        if ((ret = read(pn532->fd, i2c->buf, sizeof(i2c->buf))) < 1) {
+            perror("I2C read error");
+            return -1;
+        }
+        // Skip status byte and padding after the frame
+        i2c->pos = 1;
+        i2c->len = ret;
+        frame_len = pn532_frame_length(&i2c->buf[1], ret - 1);
+        if (frame_len && frame_len + 1 < i2c->len) i2c->len = frame_len + 1;
+    }
+
+    if (len > i2c->len - i2c->pos) len = i2c->len - i2c->pos;
+    memcpy(buffer, &i2c->buf[i2c->pos], len);
+    i2c->pos += len;
+    return (int)len;
+}
+
+static void i2c_close(pn532_t *pn532) {
+    if (pn532->fd != -1) {
+        close(pn532->fd);
+        pn532->fd = -1;
+    }
+    free(pn532->priv);
+    pn532->priv = NULL;
+}
+
+const pn532_transport_t pn532_i2c_transport =
+{
+    "i2c", 0, i2c_open, i2c_write, i2c_read, i2c_poll, i2c_close
+};
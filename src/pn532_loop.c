@@ -0,0 +1,113 @@
+/* pn532_loop.c - In-memory loopback transport
+ *
+ * No bus at all: written frames go to an optional responder callback (or are
+ * just kept for pn532_loop_tx()), and reads are served from a queue filled by
+ * the responder or pn532_loop_feed(). Reading from an empty queue returns 0
+ * bytes instead of blocking, so the framing layer reports a read error.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "pn532_com.h"
+#include "pn532_transport.h"
+
+#define LOOP_QUEUE_SIZE     4096
+#define LOOP_ACK_FRAME      {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00}
+#define PN532_TFI_RECEIVE   0xD5
+
+typedef struct
+{
+    uint8_t rx[LOOP_QUEUE_SIZE];
+    size_t rx_pos;
+    size_t rx_len;
+    uint8_t tx[LOOP_QUEUE_SIZE];        // Last data written
+    size_t tx_len;
+    pn532_loop_responder responder;
+    void *ctx;
+} loop_priv_t;
+
+static int loop_open(pn532_t *pn532, const char *device) {
+    if (!(pn532->priv = calloc(1, sizeof(loop_priv_t)))) return -1;
+    return 0;
+}
+
+int pn532_loop_feed(pn532_t *pn532, const uint8_t *data, size_t len) {
+    loop_priv_t *loop = pn532->priv;
+
+    if (loop->rx_pos == loop->rx_len) loop->rx_pos = loop->rx_len = 0;
+    if (loop->rx_pos && loop->rx_len + len > sizeof(loop->rx)) {
+        memmove(loop->rx, &loop->rx[loop->rx_pos], loop->rx_len - loop->rx_pos);
+        loop->rx_len -= loop->rx_pos;
+        loop->rx_pos = 0;
+    }
+    if (loop->rx_len + len > sizeof(loop->rx)) return -1;
+
+    memcpy(&loop->rx[loop->rx_len], data, len);
+    loop->rx_len += len;
+    return 0;
+}
+
+/* Queue ACK and a response frame for cmd, like the PN532 would send it */
+int pn532_loop_feed_response(pn532_t *pn532, uint8_t cmd, const uint8_t *data, size_t len) {
+    uint8_t ack[] = LOOP_ACK_FRAME;
+    uint8_t frame[len + 9];
+    int ret;
+
+    if (ret = pn532_loop_feed(pn532, ack, sizeof(ack))) return ret;
+    return pn532_loop_feed(pn532, frame, pn532_build_frame(PN532_TFI_RECEIVE, cmd + 1, data, len, frame));
+}
+
+void pn532_loop_set_responder(pn532_t *pn532, pn532_loop_responder responder, void *ctx) {
+    loop_priv_t *loop = pn532->priv;
+
+    loop->responder = responder;
+    loop->ctx = ctx;
+}
+
+/* Copy out what has been written last */
+size_t pn532_loop_tx(pn532_t *pn532, uint8_t *buffer, size_t len) {
+    loop_priv_t *loop = pn532->priv;
+
+    if (len > loop->tx_len) len = loop->tx_len;
+    memcpy(buffer, loop->tx, len);
+    return len;
+}
+
+static int loop_write(pn532_t *pn532, const uint8_t *data, size_t len) {
+    loop_priv_t *loop = pn532->priv;
+    uint8_t rx[LOOP_QUEUE_SIZE];
+    size_t rx_len;
+
+    loop->tx_len = len > sizeof(loop->tx) ? sizeof(loop->tx) : len;
+    memcpy(loop->tx, data, loop->tx_len);
+
+    if (loop->responder && (rx_len = loop->responder(loop->ctx, data, len, rx, sizeof(rx))))
+        return pn532_loop_feed(pn532, rx, rx_len);
+    return 0;
+}
+
+static int loop_read(pn532_t *pn532, uint8_t *buffer, size_t len) {
+    loop_priv_t *loop = pn532->priv;
+
+    if (len > loop->rx_len - loop->rx_pos) len = loop->rx_len - loop->rx_pos;
+    memcpy(buffer, &loop->rx[loop->rx_pos], len);
+    loop->rx_pos += len;
+    return (int)len;
+}
+
+static int loop_poll(pn532_t *pn532, int timeout_ms) {
+    loop_priv_t *loop = pn532->priv;
+
+    return loop->rx_pos < loop->rx_len;
+}
+
+static void loop_close(pn532_t *pn532) {
+    free(pn532->priv);
+    pn532->priv = NULL;
+}
+
+const pn532_transport_t pn532_loop_transport =
+{
+    "loop", 0, loop_open, loop_write, loop_read, loop_poll, loop_close
+};
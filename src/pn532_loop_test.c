@@ -0,0 +1,339 @@
+/* pn532_loop_test.c - Framing layer tests and benchmark on the loopback transport
+ *
+ *   pn532_loop_test          Run the tests, exit code 1 if any failed
+ *   pn532_loop_test -b [n]   Benchmark n exchanges / encoded tags (default 10000)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "pn532_com.h"
+#include "pn532_transport.h"
+#include "pn532_trace.h"
+#include "pn532_hf15.h"
+#include "pn532_encode.h"
+#include "pn532_ndef.h"
+
+#define TAG_BLOCKS      64
+#define TAG_BLOCK_SIZE  4
+
+static int failed;
+
+#define CHECK(x) do { if (!(x)) { printf("%s:%d: %s failed\n", __FILE__, __LINE__, #x); failed++; } } while (0)
+
+/* Simulated ISO15693 tag behind a PN532 */
+static uint8_t tag_mem[TAG_BLOCKS * TAG_BLOCK_SIZE];
+static int tag_single_only;     // Answer Read Multiple Blocks with "not supported"
+
+static size_t tag_responder(void *ctx, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_max) {
+    static const uint8_t ack[] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+    static const uint8_t uid[8] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0xE0};
+    const uint8_t *cmd = &tx[7];
+    uint8_t data[256];
+    size_t len = 0;
+
+    // D4 frames only, ACK frames written by the host are ignored
+    if (tx_len < 9 || tx[5] != 0xD4) return 0;
+
+    switch (tx[6])
+    {
+    case InListPassiveTarget:
+        data[0] = 1;
+        data[1] = 1;
+        memcpy(&data[2], uid, sizeof(uid));
+        len = 10;
+        break;
+    case InDataExchange:
+        data[0] = 0x00;
+        len = 1;
+        if (cmd[1] == 0x20) {           // Read Single Block
+            memcpy(&data[1], &tag_mem[cmd[2] * TAG_BLOCK_SIZE], TAG_BLOCK_SIZE);
+            len += TAG_BLOCK_SIZE;
+        } else if (cmd[1] == 0x23 && tag_single_only) {
+            data[1] = 0x01;             // Error flag, command not supported
+            data[2] = 0x01;
+            len += 2;
+        } else if (cmd[1] == 0x23) {    // Read Multiple Blocks
+            memcpy(&data[1], &tag_mem[cmd[2] * TAG_BLOCK_SIZE], (cmd[3] + 1) * TAG_BLOCK_SIZE);
+            len += (cmd[3] + 1) * TAG_BLOCK_SIZE;
+        } else if (cmd[1] == 0x21) {    // Write Single Block
+            memcpy(&tag_mem[cmd[2] * TAG_BLOCK_SIZE], &cmd[3], TAG_BLOCK_SIZE);
+        }
+        break;
+    default:
+        break;
+    }
+
+    memcpy(rx, ack, sizeof(ack));
+    return sizeof(ack) + pn532_build_frame(0xD5, tx[6] + 1, data, len, &rx[sizeof(ack)]);
+}
+
+static unsigned long elapsed_us(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000UL + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static void test_ack_response(pn532_t *pn532) {
+    uint8_t fw[4] = {0x32, 0x01, 0x06, 0x07};
+    uint8_t tx[16];
+
+    CHECK(pn532_send_command(pn532, GetFirmwareVersion, NULL, 0) == 0);
+    CHECK(pn532_loop_tx(pn532, tx, sizeof(tx)) == 9);
+    CHECK(tx[5] == 0xD4 && tx[6] == GetFirmwareVersion);
+
+    CHECK(pn532_loop_feed_response(pn532, GetFirmwareVersion, fw, sizeof(fw)) == 0);
+    CHECK(pn532_wait_response(pn532, GetFirmwareVersion) == 0);
+    CHECK(pn532->result.cmd == GetFirmwareVersion);
+    CHECK(pn532->result.len == sizeof(fw) && !memcmp(pn532->result.data, fw, sizeof(fw)));
+}
+
+static void test_status(pn532_t *pn532) {
+    uint8_t data[21] = {0x00};
+    int i;
+
+    // Short frame: status byte stays in data[0]
+    data[1] = 0xAB;
+    CHECK(pn532_loop_feed_response(pn532, InDataExchange, data, 2) == 0);
+    CHECK(pn532_wait_response(pn532, InDataExchange) == 0);
+    CHECK(pn532->result.status == 0 && pn532->result.len == 2 && pn532->result.data[1] == 0xAB);
+
+    // Long frame: status byte is stripped
+    for (i = 1; i < sizeof(data); i++) data[i] = i;
+    CHECK(pn532_loop_feed_response(pn532, InDataExchange, data, sizeof(data)) == 0);
+    CHECK(pn532_wait_response(pn532, InDataExchange) == 0);
+    CHECK(pn532->result.status == 0 && pn532->result.len == sizeof(data) - 1);
+    CHECK(!memcmp(pn532->result.data, &data[1], sizeof(data) - 1));
+
+    // Error status is kept
+    data[0] = 0x01;
+    CHECK(pn532_loop_feed_response(pn532, InDataExchange, data, sizeof(data)) == 0);
+    CHECK(pn532_wait_response(pn532, InDataExchange) == 0);
+    CHECK(pn532->result.status == 0x01 && pn532->result.len == sizeof(data) && pn532->result.data[0] == 0x01);
+}
+
+static int feed_corrupted(pn532_t *pn532, int index, uint8_t value) {
+    uint8_t data[3] = {0x11, 0x22, 0x33};
+    uint8_t frame[16];
+    size_t len;
+
+    len = pn532_build_frame(0xD5, GetFirmwareVersion + 1, data, sizeof(data), frame);
+    frame[index] = value;
+    return pn532_loop_feed(pn532, frame, len);
+}
+
+/* Drop what is left of a rejected frame */
+static void flush(pn532_t *pn532) {
+    uint8_t b;
+
+    while (pn532_read(pn532, &b, 1) == 1);
+}
+
+static void test_frame_errors(pn532_t *pn532) {
+    // Frame: 00 00 FF LEN LCS D5 CMD d0 d1 d2 DCS 00
+    CHECK(feed_corrupted(pn532, 4, 0x00) == 0);
+    CHECK(pn532_read_response(pn532, NULL) == -3);
+    flush(pn532);
+
+    CHECK(feed_corrupted(pn532, 10, 0x00) == 0);
+    CHECK(pn532_read_response(pn532, NULL) == -4);
+    flush(pn532);
+
+    CHECK(feed_corrupted(pn532, 11, 0x55) == 0);
+    CHECK(pn532_read_response(pn532, NULL) == -5);
+    flush(pn532);
+
+    CHECK(feed_corrupted(pn532, 5, 0xD4) == 0);
+    CHECK(pn532_read_response(pn532, NULL) == -4);      // TFI is covered by the data checksum
+    flush(pn532);
+
+    // Nothing queued: no timeout configured returns a short read, with timeout as well
+    CHECK(pn532_read_response(pn532, NULL) == -1);
+    pn532->timeout_ms = 0;
+    CHECK(pn532_wait_response(pn532, GetFirmwareVersion) == -1);
+    pn532->timeout_ms = -1;
+}
+
+static void test_hf15(pn532_t *pn532) {
+    uint8_t block[TAG_BLOCK_SIZE] = {0xDE, 0xAD, 0xBE, 0xEF};
+    uint8_t buffer[TAG_BLOCKS * TAG_BLOCK_SIZE];
+
+    pn532_loop_set_responder(pn532, tag_responder, NULL);
+    CHECK(hf15_write_block(pn532, 3, block, sizeof(block)) == 0);
+    memset(buffer, 0, sizeof(buffer));
+    CHECK(hf15_read_block(pn532, 3, buffer, TAG_BLOCK_SIZE) == 0);
+    CHECK(!memcmp(buffer, block, sizeof(block)));
+    CHECK(hf15_dump(pn532, 0, TAG_BLOCKS, TAG_BLOCK_SIZE, buffer) == 0);
+    CHECK(!memcmp(buffer, tag_mem, sizeof(tag_mem)));
+
+    // Tag without Read Multiple Blocks
+    tag_single_only = 1;
+    memset(buffer, 0, sizeof(buffer));
+    CHECK(hf15_dump(pn532, 0, TAG_BLOCKS, TAG_BLOCK_SIZE, buffer) == 0);
+    CHECK(!memcmp(buffer, tag_mem, sizeof(tag_mem)));
+    tag_single_only = 0;
+    pn532_loop_set_responder(pn532, NULL, NULL);
+}
+
+static void tag_load(const uint8_t *image, size_t len, ndef_tag_t *tag) {
+    memset(tag_mem, 0, sizeof(tag_mem));
+    memcpy(tag_mem, image, len);
+    ndef_invalidate(tag);
+}
+
+static void test_ndef(pn532_t *pn532) {
+    // CC with 64 bytes data area
+    static const uint8_t blank[] = {0xE1, 0x40, 0x08, 0x00};
+    static const uint8_t after_lock[] = {0xE1, 0x40, 0x08, 0x00, 0x01, 0x03, 0xA0, 0x10, 0x44, 0x03, 0x00, 0xFE};
+    static const uint8_t following[] = {0xE1, 0x40, 0x08, 0x00, 0x03, 0x08, 0xD1, 0x01, 0x04, 0x54, 0x02, 0x65, 0x6E, 0x78,
+                                        0xFD, 0x02, 0x77, 0x88, 0xFE};
+    static const uint8_t huge[] = {0xE1, 0x40, 0x08, 0x00, 0x03, 0x07, 0xC1, 0x01, 0xFF, 0xFF, 0xFF, 0xF9, 0x54, 0xFE};
+    static const uint8_t text[] = {0xD1, 0x01, 0x04, 0x54, 0x02, 0x65, 0x6E, 0x78};   // Text record "x", en
+    ndef_tag_t tag;
+    ndef_record_t rec;
+    uint8_t buffer[8];
+
+    pn532_loop_set_responder(pn532, tag_responder, NULL);
+
+    // Blank tag: the message goes right after the CC, nothing beyond the head blocks is read
+    tag_load(blank, sizeof(blank), &tag);
+    CHECK(ndef_open(pn532, &tag) == NDEF_NO_MESSAGE);
+    CHECK(tag.tlv_off == 4 && tag.blocks_read == NDEF_HEAD_BLOCKS);
+    CHECK(ndef_write(pn532, &tag, text, sizeof(text)) == 0);
+    CHECK(tag_mem[4] == 0x03 && tag_mem[5] == sizeof(text) && !memcmp(&tag_mem[6], text, sizeof(text)));
+
+    // Existing NDEF TLV
+    ndef_invalidate(&tag);
+    CHECK(ndef_open(pn532, &tag) == 0);
+    CHECK(tag.msg_off == 6 && tag.msg_len == sizeof(text));
+    memset(&rec, 0, sizeof(rec));
+    CHECK(ndef_next_record(pn532, &tag, &rec) == 0);
+    CHECK(rec.type_len == 1 && rec.payload_len == 4 && rec.payload_off == 4 && rec.next == sizeof(text));
+    CHECK(ndef_read(pn532, &tag, rec.payload_off, buffer, rec.payload_len) == 0 && !memcmp(buffer, &text[4], 4));
+    CHECK(ndef_next_record(pn532, &tag, &rec) == NDEF_END);
+
+    // NDEF TLV after a lock control TLV, grows over its terminator
+    tag_load(after_lock, sizeof(after_lock), &tag);
+    CHECK(ndef_open(pn532, &tag) == 0);
+    CHECK(tag.tlv_off == 9 && tag.msg_len == 0);
+    CHECK(ndef_write(pn532, &tag, text, sizeof(text)) == 0);
+    CHECK(!memcmp(tag_mem, after_lock, 9) && tag_mem[9] == 0x03 && tag_mem[10] == sizeof(text));
+    CHECK(!memcmp(&tag_mem[11], text, sizeof(text)) && tag_mem[11 + sizeof(text)] == 0xFE);
+
+    // Shrink and grow with a proprietary TLV following the message
+    tag_load(following, sizeof(following), &tag);
+    CHECK(ndef_open(pn532, &tag) == 0);
+    CHECK(ndef_write(pn532, &tag, text, 4) == 0);
+    CHECK(tag_mem[5] == 4 && !memcmp(&tag_mem[10], "\0\0\0\0", 4) && !memcmp(&tag_mem[14], &following[14], 5));
+    CHECK(ndef_write(pn532, &tag, text, sizeof(text)) == 0);
+    CHECK(!memcmp(tag_mem, following, sizeof(following)));
+    CHECK(ndef_write(pn532, &tag, text, sizeof(text) + 1) == NDEF_TOO_LARGE);
+    CHECK(!memcmp(tag_mem, following, sizeof(following)));
+
+    // Record lengths beyond the message
+    tag_load(huge, sizeof(huge), &tag);
+    CHECK(ndef_open(pn532, &tag) == 0);
+    memset(&rec, 0, sizeof(rec));
+    CHECK(ndef_next_record(pn532, &tag, &rec) == NDEF_FORMAT);
+
+    pn532_loop_set_responder(pn532, NULL, NULL);
+}
+
+/* Record a session on a loopback transport that needs the HSU wakeup, then replay it */
+static void test_trace_replay(void) {
+    static pn532_transport_t hsu_loop;
+    char path[] = "/tmp/pn532_loop_test.XXXXXX";
+    uint8_t block[TAG_BLOCK_SIZE], buffer[TAG_BLOCKS * TAG_BLOCK_SIZE], replayed[sizeof(buffer)];
+    pn532_t rec, replay;
+    int fd;
+
+    hsu_loop = pn532_loop_transport;
+    hsu_loop.flags |= PN532_TR_WAKEUP;
+    if ((fd = mkstemp(path)) < 0) {
+        CHECK(fd >= 0);
+        return;
+    }
+    close(fd);
+
+    CHECK(pn532_open_transport(&rec, &hsu_loop, "") == 0);
+    pn532_loop_set_responder(&rec, tag_responder, NULL);
+    CHECK(pn532_trace_start(&rec, path, 0) == 0);
+    CHECK(pn532_set_normal_mode(&rec) == 0);
+    flush(&rec);        // Rest of the SAMConfiguration answer
+    CHECK(hf15_read_block(&rec, 3, block, sizeof(block)) == 0);
+    CHECK(hf15_dump(&rec, 0, TAG_BLOCKS, TAG_BLOCK_SIZE, buffer) == 0);
+    pn532_close(&rec);
+
+    CHECK(pn532_replay_open(&replay, path, PN532_REPLAY_MAX_SPEED | PN532_REPLAY_STRICT) == 0);
+    CHECK(pn532_set_normal_mode(&replay) == 0);
+    flush(&replay);
+    memset(replayed, 0, sizeof(replayed));
+    CHECK(hf15_read_block(&replay, 3, replayed, TAG_BLOCK_SIZE) == 0);
+    CHECK(!memcmp(replayed, block, sizeof(block)));
+    CHECK(hf15_dump(&replay, 0, TAG_BLOCKS, TAG_BLOCK_SIZE, replayed) == 0);
+    CHECK(!memcmp(replayed, buffer, sizeof(buffer)));
+    CHECK(hf15_read_block(&replay, 3, replayed, TAG_BLOCK_SIZE) == -1);     // End of trace
+    pn532_close(&replay);
+
+    unlink(path);
+}
+
+static void bench(pn532_t *pn532, unsigned int n) {
+    uint8_t image[TAG_BLOCKS * TAG_BLOCK_SIZE], block[TAG_BLOCK_SIZE], uid[8];
+    hf15_encode_job_t job;
+    hf15_encode_stats_t stats;
+    struct timespec start;
+    unsigned long us;
+    unsigned int i;
+
+    pn532_loop_set_responder(pn532, tag_responder, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < n; i++)
+        if (hf15_read_block(pn532, i % TAG_BLOCKS, block, sizeof(block))) break;
+    us = elapsed_us(&start);
+    printf("hf15_read_block: %u exchanges, %.3f us each\n", i, i ? (double)us / i : 0.0);
+
+    memset(&job, 0, sizeof(job));
+    memset(&stats, 0, sizeof(stats));
+    for (i = 0; i < sizeof(image); i++) image[i] = i;
+    job.image = image;
+    job.blocks = TAG_BLOCKS;
+    job.block_size = TAG_BLOCK_SIZE;
+    job.serial_block = 1;
+    job.serial_len = 4;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < n; i++)
+        if (hf15_encode_tag(pn532, &job, i, uid, &stats)) break;
+    us = elapsed_us(&start);
+    printf("hf15_encode_tag: %u tags of %u blocks, %.3f us each, %.0f tags/minute (host side only, no bus)\n",
+           i, TAG_BLOCKS, i ? (double)us / i : 0.0, us ? i * 60e6 / us : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+    pn532_t pn532;
+
+    if (pn532_open(&pn532, "loop:") != 0) {
+        perror("Error opening loopback");
+        return 1;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "-b")) {
+        bench(&pn532, argc > 2 ? atoi(argv[2]) : 10000);
+    } else {
+        test_ack_response(&pn532);
+        test_status(&pn532);
+        test_frame_errors(&pn532);
+        test_hf15(&pn532);
+        test_ndef(&pn532);
+        test_trace_replay();
+        printf("%s\n", failed ? "FAILED" : "OK");
+    }
+
+    pn532_close(&pn532);
+    return failed != 0;
+}
@@ -0,0 +1,293 @@
+/* pn532_ndef.c - NDEF on ISO15693 (NFC Forum Type 5) tags
+ *
+ * Blocks are only read when they are needed: ndef_open() reads the capability
+ * container and the first TLV, records are parsed as the caller iterates
+ * them and payloads are read on request. Every block read or written is kept
+ * in the ndef_tag_t, which stays valid as long as ndef_open() sees the same
+ * UID. ndef_write() only writes blocks whose content changes.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "pn532_com.h"
+#include "pn532_hf15.h"
+#include "pn532_ndef.h"
+
+#define NDEF_TLV_NDEF       0x03
+#define NDEF_TLV_TERMINATOR 0xFE
+#define NDEF_TLV_NULL       0x00
+
+#define BLOCK_CACHED(tag, b)    ((tag)->cached[(b) >> 3] & (1 << ((b) & 7)))
+
+/* Make sure blocks first..first+count-1 are in tag->data */
+static int ndef_load(pn532_t *pn532, ndef_tag_t *tag, unsigned int first, unsigned int count) {
+    unsigned int block, run, i;
+    int ret;
+
+    for (block = first; block < first + count; block += run) {
+        if (BLOCK_CACHED(tag, block)) {
+            tag->cache_hits++;
+            run = 1;
+            continue;
+        }
+
+        // Read the run of missing blocks at once
+        for (run = 1; block + run < first + count; run++)
+            if (BLOCK_CACHED(tag, block + run)) break;
+
+        tag->reads++;
+        if (ret = hf15_dump(pn532, block, run, NDEF_BLOCK_SIZE, &tag->data[block * NDEF_BLOCK_SIZE])) return ret;
+
+        for (i = 0; i < run; i++)
+            tag->cached[(block + i) >> 3] |= 1 << ((block + i) & 7);
+        tag->blocks_read += run;
+    }
+    return 0;
+}
+
+/* Copy len bytes at tag memory address addr into buffer */
+static int ndef_fetch(pn532_t *pn532, ndef_tag_t *tag, unsigned int addr, uint8_t *buffer, unsigned int len) {
+    int ret;
+
+    if (!len) return 0;
+    if (addr + len > tag->data_end) return NDEF_FORMAT;
+    if (ret = ndef_load(pn532, tag, addr / NDEF_BLOCK_SIZE,
+                        (addr + len - 1) / NDEF_BLOCK_SIZE - addr / NDEF_BLOCK_SIZE + 1)) return ret;
+    memcpy(buffer, &tag->data[addr], len);
+    return 0;
+}
+
+/* Type, header size and value length of the TLV at pos, NULL/terminator have no length */
+static int ndef_tlv_at(pn532_t *pn532, ndef_tag_t *tag, unsigned int pos, uint8_t *type, unsigned int *hdr, unsigned int *len) {
+    uint8_t tlv[4];
+    int ret;
+
+    if (ret = ndef_fetch(pn532, tag, pos, tlv, 1)) return ret;
+    *type = tlv[0];
+    *hdr = 1;
+    *len = 0;
+    if (tlv[0] == NDEF_TLV_NULL || tlv[0] == NDEF_TLV_TERMINATOR) return 0;
+
+    if (ret = ndef_fetch(pn532, tag, pos + 1, &tlv[1], 1)) return ret;
+    if (tlv[1] == 0xFF) {
+        if (ret = ndef_fetch(pn532, tag, pos + 2, &tlv[2], 2)) return ret;
+        *len = (tlv[2] << 8) | tlv[3];
+        *hdr = 4;
+    } else {
+        *len = tlv[1];
+        *hdr = 2;
+    }
+    if (pos + *hdr + *len > tag->data_end) return NDEF_FORMAT;
+    return 0;
+}
+
+/* Find the NDEF TLV, otherwise remember where a new one goes
+ * A NULL TLV starts the free space, the scan stops there
+ */
+static int ndef_find_tlv(pn532_t *pn532, ndef_tag_t *tag) {
+    unsigned int pos = tag->cc_len, len, hdr;
+    uint8_t type;
+    int ret;
+
+    while (pos < tag->data_end) {
+        if (ret = ndef_tlv_at(pn532, tag, pos, &type, &hdr, &len)) return ret;
+        if (type == NDEF_TLV_TERMINATOR || type == NDEF_TLV_NULL) break;
+        if (type == NDEF_TLV_NDEF) {
+            tag->tlv_off = pos;
+            tag->msg_off = pos + hdr;
+            tag->msg_len = len;
+            return 0;
+        }
+        pos += hdr + len;
+    }
+
+    // Other TLVs up to the end of the data area leave no room, ndef_write() fails then
+    tag->tlv_off = pos < tag->data_end ? pos : tag->data_end;
+    return NDEF_NO_MESSAGE;
+}
+
+/* Check that pos..end-1 only holds NULL TLVs, up to a terminator (*terminated is set then) */
+static int ndef_check_free(pn532_t *pn532, ndef_tag_t *tag, unsigned int pos, unsigned int end, int *terminated) {
+    uint8_t type;
+    int ret;
+
+    *terminated = 0;
+    for (; pos < end; pos++) {
+        if (ret = ndef_fetch(pn532, tag, pos, &type, 1)) return ret;
+        if (type == NDEF_TLV_TERMINATOR) {
+            *terminated = 1;
+            return 0;
+        }
+        if (type != NDEF_TLV_NULL) return NDEF_TOO_LARGE;
+    }
+    return 0;
+}
+
+void ndef_invalidate(ndef_tag_t *tag) {
+    memset(tag, 0, sizeof(*tag));
+}
+
+/* Select the tag in the field, read its CC and locate the NDEF message
+ * Nothing is read if the tag has the UID of the cached one
+ */
+int ndef_open(pn532_t *pn532, ndef_tag_t *tag) {
+    hf15_tag_scan scan;
+    unsigned int mlen;
+    int ret;
+
+    memset(&scan, 0, sizeof(scan));
+    if ((ret = hf15_scan(pn532, &scan)) < 0) return ret;
+    if (ret || !scan.tagType) return HF_TAG_NO;
+
+    if (tag->cc_len && !memcmp(tag->uid, scan.uid, sizeof(tag->uid)))
+        return tag->msg_off ? 0 : NDEF_NO_MESSAGE;
+
+    ndef_invalidate(tag);
+    memcpy(tag->uid, scan.uid, sizeof(tag->uid));
+
+    if (ret = ndef_load(pn532, tag, 0, NDEF_HEAD_BLOCKS)) goto error;
+    memcpy(tag->cc, tag->data, sizeof(tag->cc));
+    if (tag->cc[0] != 0xE1 && tag->cc[0] != 0xE2) {
+        ret = NDEF_NO_CC;
+        goto error;
+    }
+
+    // MLEN 0 in byte 2 means 8 byte CC with a 16 bit MLEN, in units of 8 bytes
+    if (tag->cc[2]) {
+        tag->cc_len = 4;
+        mlen = tag->cc[2] * 8;
+    } else {
+        tag->cc_len = 8;
+        mlen = ((tag->cc[6] << 8) | tag->cc[7]) * 8;
+    }
+    if (mlen > sizeof(tag->data) - tag->cc_len) mlen = sizeof(tag->data) - tag->cc_len;
+    tag->data_end = tag->cc_len + mlen;
+
+    if ((ret = ndef_find_tlv(pn532, tag)) && ret != NDEF_NO_MESSAGE) goto error;
+    return ret;
+
+error:
+    ndef_invalidate(tag);
+    return ret;
+}
+
+/* Read len bytes of the NDEF message starting at offset */
+int ndef_read(pn532_t *pn532, ndef_tag_t *tag, uint16_t offset, uint8_t *buffer, uint16_t len) {
+    if (!tag->msg_off || offset + len > tag->msg_len) return PAR_ERR;
+    return ndef_fetch(pn532, tag, tag->msg_off + offset, buffer, len);
+}
+
+/* Parse the record following rec, start with a zeroed rec
+ * Only the record header is read, use ndef_read() for type, ID and payload
+ */
+int ndef_next_record(pn532_t *pn532, ndef_tag_t *tag, ndef_record_t *rec) {
+    uint8_t hdr[7];
+    unsigned int off = rec->next, pos;
+    int ret;
+
+    if (!tag->msg_off) return NDEF_NO_MESSAGE;
+    if ((rec->flags & NDEF_ME) || off >= tag->msg_len) return NDEF_END;
+
+    // Flags, TYPE_LENGTH, PAYLOAD_LENGTH (1 or 4), ID_LENGTH (if IL)
+    if (off + 2 > tag->msg_len) return NDEF_FORMAT;
+    if (ret = ndef_read(pn532, tag, off, hdr, 2)) return ret;
+    rec->flags = hdr[0];
+    rec->type_len = hdr[1];
+    pos = off + 2;
+
+    if (rec->flags & NDEF_SR) {
+        if (pos + 1 > tag->msg_len) return NDEF_FORMAT;
+        if (ret = ndef_read(pn532, tag, pos, &hdr[2], 1)) return ret;
+        rec->payload_len = hdr[2];
+        pos += 1;
+    } else {
+        if (pos + 4 > tag->msg_len) return NDEF_FORMAT;
+        if (ret = ndef_read(pn532, tag, pos, &hdr[2], 4)) return ret;
+        rec->payload_len = ((uint32_t)hdr[2] << 24) | (hdr[3] << 16) | (hdr[4] << 8) | hdr[5];
+        pos += 4;
+    }
+
+    rec->id_len = 0;
+    if (rec->flags & NDEF_IL) {
+        if (pos + 1 > tag->msg_len) return NDEF_FORMAT;
+        if (ret = ndef_read(pn532, tag, pos, &hdr[6], 1)) return ret;
+        rec->id_len = hdr[6];
+        pos += 1;
+    }
+
+    // Lengths come from the tag, check them before adding them up
+    if (rec->type_len > tag->msg_len - pos) return NDEF_FORMAT;
+    rec->type_off = pos;
+    pos += rec->type_len;
+    if (rec->id_len > tag->msg_len - pos) return NDEF_FORMAT;
+    rec->id_off = pos;
+    pos += rec->id_len;
+    if (rec->payload_len > tag->msg_len - pos) return NDEF_FORMAT;
+    rec->payload_off = pos;
+    pos += rec->payload_len;
+    if (pos <= off) return NDEF_FORMAT;
+    rec->next = pos;
+    return 0;
+}
+
+/* Replace the NDEF message, only blocks that differ from the tag are written
+ * The message may grow over NULL TLVs, TLVs following it are kept
+ */
+int ndef_write(pn532_t *pn532, ndef_tag_t *tag, const uint8_t *msg, uint16_t len) {
+    uint8_t block_data[NDEF_BLOCK_SIZE];
+    unsigned int hdr, total, new_end, old_end, first, last, block, addr, start, end;
+    int terminated, ret;
+
+    if (!tag->cc_len) return PAR_ERR;
+    if (tag->cc[1] & 0x03) return NDEF_READ_ONLY;
+
+    hdr = len < 0xFF ? 2 : 4;
+    new_end = tag->tlv_off + hdr + len;
+    if (new_end > tag->data_end) return NDEF_TOO_LARGE;
+    old_end = tag->msg_off ? tag->msg_off + tag->msg_len : tag->tlv_off;
+    if (ret = ndef_check_free(pn532, tag, old_end, new_end, &terminated)) return ret;
+
+    uint8_t tlv[(new_end > old_end ? new_end : old_end) - tag->tlv_off + 1];
+
+    tlv[0] = NDEF_TLV_NDEF;
+    if (hdr == 2) {
+        tlv[1] = len;
+    } else {
+        tlv[1] = 0xFF;
+        tlv[2] = len >> 8;
+        tlv[3] = len & 0xFF;
+    }
+    memcpy(&tlv[hdr], msg, len);
+    total = hdr + len;
+    // A shorter message is padded with NULL TLVs, so whatever follows stays in place
+    while (tag->tlv_off + total < old_end) tlv[total++] = NDEF_TLV_NULL;
+    if (terminated && tag->tlv_off + total < tag->data_end) tlv[total++] = NDEF_TLV_TERMINATOR;
+
+    // Partially covered blocks keep their other bytes, unchanged blocks are skipped
+    first = tag->tlv_off / NDEF_BLOCK_SIZE;
+    last = (tag->tlv_off + total - 1) / NDEF_BLOCK_SIZE;
+    if (ret = ndef_load(pn532, tag, first, last - first + 1)) return ret;
+
+    // Backwards, so the TLV length is written last
+    for (block = last + 1; block-- > first; ) {
+        addr = block * NDEF_BLOCK_SIZE;
+        start = addr > tag->tlv_off ? addr : tag->tlv_off;
+        end = addr + NDEF_BLOCK_SIZE < tag->tlv_off + total ? addr + NDEF_BLOCK_SIZE : tag->tlv_off + total;
+
+        memcpy(block_data, &tag->data[addr], NDEF_BLOCK_SIZE);
+        memcpy(&block_data[start - addr], &tlv[start - tag->tlv_off], end - start);
+        if (!memcmp(block_data, &tag->data[addr], NDEF_BLOCK_SIZE)) continue;
+
+        if (ret = hf15_write_block(pn532, block, block_data, NDEF_BLOCK_SIZE)) {
+            // State of the block is unknown now
+            tag->cached[block >> 3] &= ~(1 << (block & 7));
+            return ret;
+        }
+        memcpy(&tag->data[addr], block_data, NDEF_BLOCK_SIZE);
+        tag->blocks_written++;
+    }
+
+    tag->msg_off = tag->tlv_off + hdr;
+    tag->msg_len = len;
+    return 0;
+}
@@ -0,0 +1,60 @@
+/* pn532_ndef.h - NDEF on ISO15693 (NFC Forum Type 5) tags */
+
+#define NDEF_BLOCK_SIZE     4
+#define NDEF_MAX_BLOCKS     256     // Block numbers are 8 bit
+#define NDEF_HEAD_BLOCKS    3       // Read on open: CC (4 or 8 bytes) and the start of the first TLV
+
+enum NdefStatus
+{
+    NDEF_NO_CC = 0x50,      // No capability container in block 0
+    NDEF_NO_MESSAGE,        // No NDEF TLV
+    NDEF_FORMAT,            // Malformed TLV or record
+    NDEF_READ_ONLY,
+    NDEF_TOO_LARGE,         // Message does not fit into the data area
+    NDEF_END                // No more records
+};
+
+/* Cached tag state, valid as long as the same UID is seen by ndef_open() */
+typedef struct
+{
+    uint8_t uid[8];
+    uint8_t cc[8];
+    uint8_t cc_len;             // 0 = nothing cached
+    uint16_t data_end;          // End of the data area (CC + MLEN * 8)
+    uint16_t tlv_off;           // NDEF TLV, or where to put one
+    uint16_t msg_off;           // NDEF message (TLV value)
+    uint16_t msg_len;
+    uint8_t data[NDEF_MAX_BLOCKS * NDEF_BLOCK_SIZE];
+    uint8_t cached[NDEF_MAX_BLOCKS / 8];    // Bitmap of blocks in data[]
+
+    unsigned long reads;        // Runs of missing blocks read with hf15_dump()
+    unsigned long blocks_read;
+    unsigned long blocks_written;
+    unsigned long cache_hits;   // Blocks served from the cache
+} ndef_tag_t;
+
+/* One record of the message, offsets are relative to the message */
+typedef struct
+{
+    uint8_t flags;              // MB, ME, CF, SR, IL and TNF
+    uint8_t type_len;
+    uint8_t id_len;
+    uint32_t payload_len;
+    uint16_t type_off;
+    uint16_t id_off;
+    uint16_t payload_off;
+    uint16_t next;              // Offset of the following record
+} ndef_record_t;
+
+#define NDEF_MB             0x80
+#define NDEF_ME             0x40
+#define NDEF_CF             0x20
+#define NDEF_SR             0x10
+#define NDEF_IL             0x08
+#define NDEF_TNF(flags)     ((flags) & 0x07)
+
+int ndef_open(pn532_t *pn532, ndef_tag_t *tag);
+void ndef_invalidate(ndef_tag_t *tag);
+int ndef_next_record(pn532_t *pn532, ndef_tag_t *tag, ndef_record_t *rec);
+int ndef_read(pn532_t *pn532, ndef_tag_t *tag, uint16_t offset, uint8_t *buffer, uint16_t len);
+int ndef_write(pn532_t *pn532, ndef_tag_t *tag, const uint8_t *msg, uint16_t len);
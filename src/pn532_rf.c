@@ -0,0 +1,126 @@
+/* pn532_rf.c - RFConfiguration (0x32) settings
+ *
+ * Every item sent is cached in pn532->rf, so setting an item to the value
+ * it already has does not cause any traffic.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "pn532_com.h"
+#include "pn532_rf.h"
+
+typedef struct
+{
+    uint8_t atr_res_timeout;
+    uint8_t retry_timeout;
+    uint8_t max_rty_com;
+    uint8_t max_retries[3];
+    uint8_t analog_106a[11];
+} rf_profile_t;
+
+/* Analog settings 106 kbps type A:
+ * CIU_RFCfg, CIU_GsNOn, CIU_CWGsP, CIU_ModGsP, CIU_DemodOwnRFOn, CIU_RxThreshold,
+ * CIU_DemodOwnRFOff, CIU_GsNOff, CIU_ModWidth, CIU_MifNFC, CIU_TxBitPhase
+ */
+static const rf_profile_t rf_profiles[] =
+{
+    [RF_PROFILE_DEFAULT] = {
+        RF_TIMEOUT_102_4MS, RF_TIMEOUT_51_2MS, 0x00, {RF_RETRY_FOREVER, 0x01, RF_RETRY_FOREVER},
+        {0x59, 0xF4, 0x3F, 0x11, 0x4D, 0x85, 0x61, 0x6F, 0x26, 0x62, 0x87}
+    },
+    [RF_PROFILE_FAST_FAIL] = {
+        RF_TIMEOUT_12_8MS, RF_TIMEOUT_6_4MS, 0x00, {0x00, 0x00, 0x00},
+        {0x59, 0xF4, 0x3F, 0x11, 0x4D, 0x85, 0x61, 0x6F, 0x26, 0x62, 0x87}
+    },
+    [RF_PROFILE_ROBUST] = {
+        RF_TIMEOUT_409_6MS, RF_TIMEOUT_204_8MS, 0x02, {0x02, 0x02, 0x10},
+        // RxGain 48dB
+        {0x79, 0xF4, 0x3F, 0x11, 0x4D, 0x85, 0x61, 0x6F, 0x26, 0x62, 0x87}
+    }
+};
+
+static int rf_config(pn532_t *pn532, uint8_t item, const uint8_t *data, size_t len, uint8_t *cache)
+{
+    uint8_t cmd[len + 1];
+    uint16_t mask = 1 << item;
+    int ret;
+
+    if ((pn532->rf.valid & mask) && !memcmp(cache, data, len)) return 0;
+
+    cmd[0] = item;
+    memcpy(&cmd[1], data, len);
+    pn532->rf.valid &= ~mask;
+    if (ret = pn532_send_command(pn532, RFConfiguration, cmd, sizeof(cmd))) return ret;
+    if (ret = pn532_wait_response(pn532, RFConfiguration)) return ret;
+
+    memcpy(cache, data, len);
+    pn532->rf.valid |= mask;
+    return 0;
+}
+
+/* Switch RF field, auto_rfca enables RF collision avoidance */
+int pn532_rf_field(pn532_t *pn532, int on, int auto_rfca) {
+    uint8_t data = (on ? 0x01 : 0x00) | (auto_rfca ? 0x02 : 0x00);
+
+    return rf_config(pn532, RfCfgField, &data, 1, &pn532->rf.field);
+}
+
+/* Timeouts, see enum Pn532RfTimeout */
+int pn532_rf_timings(pn532_t *pn532, uint8_t atr_res_timeout, uint8_t retry_timeout) {
+    uint8_t data[3] = {0x00, atr_res_timeout, retry_timeout};
+
+    return rf_config(pn532, RfCfgTimings, data, sizeof(data), pn532->rf.timings);
+}
+
+/* Retries of InCommunicateThru/InDataExchange when the target does not answer */
+int pn532_rf_max_rty_com(pn532_t *pn532, uint8_t retries) {
+    return rf_config(pn532, RfCfgMaxRtyCOM, &retries, 1, &pn532->rf.max_rty_com);
+}
+
+/* Retries for ATR_REQ, PSL_REQ and passive activation (InListPassiveTarget), RF_RETRY_FOREVER = infinite */
+int pn532_rf_max_retries(pn532_t *pn532, uint8_t atr, uint8_t psl, uint8_t passive_activation) {
+    uint8_t data[3] = {atr, psl, passive_activation};
+
+    return rf_config(pn532, RfCfgMaxRetries, data, sizeof(data), pn532->rf.max_retries);
+}
+
+/* 11 CIU register values, see rf_profiles for order */
+int pn532_rf_analog_106a(pn532_t *pn532, const uint8_t *regs) {
+    return rf_config(pn532, RfCfgAnalog106A, regs, sizeof(pn532->rf.analog_106a), pn532->rf.analog_106a);
+}
+
+/* CIU_RFCfg, CIU_GsNOn, CIU_CWGsP, CIU_ModGsP, CIU_DemodOwnRFOn, CIU_RxThreshold, CIU_DemodOwnRFOff, CIU_GsNOff */
+int pn532_rf_analog_212_424(pn532_t *pn532, const uint8_t *regs) {
+    return rf_config(pn532, RfCfgAnalog212_424, regs, sizeof(pn532->rf.analog_212_424), pn532->rf.analog_212_424);
+}
+
+/* CIU_GsNOn, CIU_ModGsP, CIU_RxThreshold */
+int pn532_rf_analog_typeb(pn532_t *pn532, const uint8_t *regs) {
+    return rf_config(pn532, RfCfgAnalogTypeB, regs, sizeof(pn532->rf.analog_typeb), pn532->rf.analog_typeb);
+}
+
+/* CIU_RxThreshold, CIU_ModWidth, CIU_MifNFC for 212, 424 and 848 kbps */
+int pn532_rf_analog_iso14443_4(pn532_t *pn532, const uint8_t *regs) {
+    return rf_config(pn532, RfCfgAnalogISO14443_4, regs, sizeof(pn532->rf.analog_iso14443_4), pn532->rf.analog_iso14443_4);
+}
+
+/* Apply a preset, only items that differ from the cached values are sent */
+int pn532_rf_apply_profile(pn532_t *pn532, enum Pn532RfProfile profile) {
+    const rf_profile_t *p;
+    int ret;
+
+    if (profile < 0 || profile >= sizeof(rf_profiles) / sizeof(rf_profiles[0])) return PAR_ERR;
+    p = &rf_profiles[profile];
+
+    if (ret = pn532_rf_timings(pn532, p->atr_res_timeout, p->retry_timeout)) return ret;
+    if (ret = pn532_rf_max_rty_com(pn532, p->max_rty_com)) return ret;
+    if (ret = pn532_rf_max_retries(pn532, p->max_retries[0], p->max_retries[1], p->max_retries[2])) return ret;
+    if (ret = pn532_rf_analog_106a(pn532, p->analog_106a)) return ret;
+
+    return 0;
+}
+
+/* Forget cached settings, i.e. after the PN532 has been reset or powered down */
+void pn532_rf_invalidate(pn532_t *pn532) {
+    pn532->rf.valid = 0;
+}
@@ -0,0 +1,55 @@
+/* pn532_rf.h - RFConfiguration (0x32) settings */
+
+enum Pn532RfCfgItem
+{
+    RfCfgField = 0x01,
+    RfCfgTimings = 0x02,
+    RfCfgMaxRtyCOM = 0x04,
+    RfCfgMaxRetries = 0x05,
+    RfCfgAnalog106A = 0x0A,
+    RfCfgAnalog212_424 = 0x0B,
+    RfCfgAnalogTypeB = 0x0C,
+    RfCfgAnalogISO14443_4 = 0x0D
+};
+
+/* Timeout values for pn532_rf_timings(), timeout = 100us * 2^(n-1) */
+enum Pn532RfTimeout
+{
+    RF_TIMEOUT_NONE = 0x00,
+    RF_TIMEOUT_100US = 0x01,
+    RF_TIMEOUT_200US = 0x02,
+    RF_TIMEOUT_400US = 0x03,
+    RF_TIMEOUT_800US = 0x04,
+    RF_TIMEOUT_1_6MS = 0x05,
+    RF_TIMEOUT_3_2MS = 0x06,
+    RF_TIMEOUT_6_4MS = 0x07,
+    RF_TIMEOUT_12_8MS = 0x08,
+    RF_TIMEOUT_25_6MS = 0x09,
+    RF_TIMEOUT_51_2MS = 0x0A,   // Default retry timeout
+    RF_TIMEOUT_102_4MS = 0x0B,  // Default ATR_RES timeout
+    RF_TIMEOUT_204_8MS = 0x0C,
+    RF_TIMEOUT_409_6MS = 0x0D,
+    RF_TIMEOUT_819_2MS = 0x0E,
+    RF_TIMEOUT_1_64S = 0x0F,
+    RF_TIMEOUT_3_28S = 0x10
+};
+
+#define RF_RETRY_FOREVER  0xFF
+
+enum Pn532RfProfile
+{
+    RF_PROFILE_DEFAULT,         // Power-on defaults of the PN532
+    RF_PROFILE_FAST_FAIL,       // Short timeouts, single activation attempt, scans return quickly if no tag
+    RF_PROFILE_ROBUST           // Long timeouts, retries, maximum receiver gain for long range
+};
+
+int pn532_rf_field(pn532_t *pn532, int on, int auto_rfca);
+int pn532_rf_timings(pn532_t *pn532, uint8_t atr_res_timeout, uint8_t retry_timeout);
+int pn532_rf_max_rty_com(pn532_t *pn532, uint8_t retries);
+int pn532_rf_max_retries(pn532_t *pn532, uint8_t atr, uint8_t psl, uint8_t passive_activation);
+int pn532_rf_analog_106a(pn532_t *pn532, const uint8_t *regs);
+int pn532_rf_analog_212_424(pn532_t *pn532, const uint8_t *regs);
+int pn532_rf_analog_typeb(pn532_t *pn532, const uint8_t *regs);
+int pn532_rf_analog_iso14443_4(pn532_t *pn532, const uint8_t *regs);
+int pn532_rf_apply_profile(pn532_t *pn532, enum Pn532RfProfile profile);
+void pn532_rf_invalidate(pn532_t *pn532);
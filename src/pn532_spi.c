@@ -0,0 +1,195 @@
+/* pn532_spi.c - SPI transport via spidev
+ *
+ * Every SPI transfer starts with an operation byte:
+ *   0x01 Data write, 0x02 Status read, 0x03 Data read
+ * The PN532 shifts LSB first. If the SPI controller can't do that, bits are
+ * reversed in software.
+ *
+ * A response is read in two transfers: the frame header, then exactly the
+ * remaining bytes of the frame. For continuation transfers the PN532 sends
+ * the next data byte while receiving the data read byte, so no byte is lost.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+#include "pn532_com.h"
+#include "pn532_transport.h"
+
+#define PN532_SPI_DW              0x01
+#define PN532_SPI_SR              0x02
+#define PN532_SPI_DR              0x03
+#define PN532_SPI_READY           0x01
+
+#define PN532_SPI_SPEED           1000000     // PN532 supports up to 5 MHz
+#define PN532_SPI_HEADER_LEN      6           // Preamble, start codes, LEN, LCS, 1st data byte
+
+typedef struct
+{
+    uint32_t speed;
+    int sw_lsb;                         // Controller has no SPI_LSB_FIRST
+    uint8_t buf[PN532_FRAME_MAX + PN532_SPI_HEADER_LEN];
+    size_t pos;
+    size_t len;
+} spi_priv_t;
+
+static uint8_t rev8(uint8_t b) {
+    b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+    b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+    b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+    return b;
+}
+
+static int spi_transfer(pn532_t *pn532, uint8_t *tx, uint8_t *rx, size_t len) {
+    spi_priv_t *spi = pn532->priv;
+    struct spi_ioc_transfer xfer;
+    size_t i;
+
+    if (spi->sw_lsb) for (i = 0; i < len; i++) tx[i] = rev8(tx[i]);
+
+    memset(&xfer, 0, sizeof(xfer));
+    xfer.tx_buf = (unsigned long)tx;
+    xfer.rx_buf = (unsigned long)rx;
+    xfer.len = len;
+    xfer.speed_hz = spi->speed;
+    xfer.bits_per_word = 8;
+    if (ioctl(pn532->fd, SPI_IOC_MESSAGE(1), &xfer) < 0) {
+        perror("SPI transfer error");
+        return -1;
+    }
+
+    if (spi->sw_lsb && rx) for (i = 0; i < len; i++) rx[i] = rev8(rx[i]);
+    return 0;
+}
+
+/* device is /dev/spidevB.C, optionally followed by @speed in Hz */
+static int spi_open(pn532_t *pn532, const char *device) {
+    spi_priv_t *spi;
+    char path[256], *p;
+    uint8_t mode = SPI_MODE_0 | SPI_LSB_FIRST;
+
+    if (!(spi = calloc(1, sizeof(*spi)))) return -1;
+    spi->speed = PN532_SPI_SPEED;
+
+    snprintf(path, sizeof(path), "%s", device);
+    if (p = strchr(path, '@')) {
+        *p++ = 0;
+        spi->speed = strtoul(p, NULL, 0);
+    }
+
+    if ((pn532->fd = open(path, O_RDWR)) == -1) {
+        perror("Unable to open SPI device");
+        free(spi);
+        return -1;
+    }
+    if (ioctl(pn532->fd, SPI_IOC_WR_MODE, &mode) < 0) {
+        mode = SPI_MODE_0;
+        spi->sw_lsb = 1;
+        if (ioctl(pn532->fd, SPI_IOC_WR_MODE, &mode) < 0) {
+            perror("Unable to set SPI mode");
+            close(pn532->fd);
+            pn532->fd = -1;
+            free(spi);
+            return -1;
+        }
+    }
+    ioctl(pn532->fd, SPI_IOC_WR_MAX_SPEED_HZ, &spi->speed);
+
+    pn532->priv = spi;
+
+    // Wake up from power down, CS low is enough but the PN532 needs 2ms afterwards
+    spi_transfer(pn532, (uint8_t[]){PN532_SPI_SR, 0x00}, NULL, 2);
+    usleep(2000);
+
+    return 0;
+}
+
+static int spi_write(pn532_t *pn532, const uint8_t *data, size_t len) {
+    uint8_t tx[len + 1];
+
+    tx[0] = PN532_SPI_DW;
+    memcpy(&tx[1], data, len);
+    return spi_transfer(pn532, tx, NULL, len + 1);
+}
+
+static int spi_poll(pn532_t *pn532, int timeout_ms) {
+    spi_priv_t *spi = pn532->priv;
+    uint8_t tx[2], rx[2];
+    struct timespec start, now;
+
+    if (spi->pos < spi->len) return 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        tx[0] = PN532_SPI_SR;
+        tx[1] = 0x00;
+        if (spi_transfer(pn532, tx, rx, sizeof(tx))) return -1;
+        if (rx[1] & PN532_SPI_READY) return 1;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (timeout_ms >= 0 &&
+            (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 >= timeout_ms)
+            return 0;
+        usleep(1000);
+    }
+}
+
+/* Read one complete frame into the buffer */
+static int spi_read_frame(pn532_t *pn532) {
+    spi_priv_t *spi = pn532->priv;
+    uint8_t tx[sizeof(spi->buf) + 1];
+    size_t frame_len, rest;
+    int ret;
+
+    if ((ret = spi_poll(pn532, -1)) <= 0) return ret;
+
+    memset(tx, 0, sizeof(tx));
+    tx[0] = PN532_SPI_DR;
+    if (spi_transfer(pn532, tx, tx, PN532_SPI_HEADER_LEN + 1)) return -1;
+    memcpy(spi->buf, &tx[1], PN532_SPI_HEADER_LEN);
+    spi->len = PN532_SPI_HEADER_LEN;
+    spi->pos = 0;
+
+    frame_len = pn532_frame_length(spi->buf, spi->len);
+    if (frame_len > sizeof(spi->buf)) frame_len = sizeof(spi->buf);
+    if (frame_len > spi->len) {
+        rest = frame_len - spi->len;
+        memset(tx, 0, rest);
+        tx[0] = PN532_SPI_DR;
+        if (spi_transfer(pn532, tx, &spi->buf[spi->len], rest)) return -1;
+        spi->len += rest;
+    }
+
+    return 1;
+}
+
+static int spi_read(pn532_t *pn532, uint8_t *buffer, size_t len) {
+    spi_priv_t *spi = pn532->priv;
+    int ret;
+
+    if (spi->pos >= spi->len && (ret = spi_read_frame(pn532)) <= 0) return ret;
+
+    if (len > spi->len - spi->pos) len = spi->len - spi->pos;
+    memcpy(buffer, &spi->buf[spi->pos], len);
+    spi->pos += len;
+    return (int)len;
+}
+
+static void spi_close(pn532_t *pn532) {
+    if (pn532->fd != -1) {
+        close(pn532->fd);
+        pn532->fd = -1;
+    }
+    free(pn532->priv);
+    pn532->priv = NULL;
+}
+
+const pn532_transport_t pn532_spi_transport =
+{
+    "spi", 0, spi_open, spi_write, spi_read, spi_poll, spi_close
+};
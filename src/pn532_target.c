@@ -0,0 +1,339 @@
+/* pn532_target.c - Host driven card emulation (NFC Forum Type 4 tag)
+ *
+ * The PN532 is configured as ISO14443-4 PICC with TgInitAsTarget and every
+ * command APDU of the reader is answered through TgGetData / TgSetData.
+ * The reader only waits a limited time for the answer, so all responses of
+ * the NDEF application (SELECTs, CC file, NDEF file in MLe sized chunks) are
+ * built in advance and looked up by the command bytes. Anything else is
+ * answered on the fly and counted as a miss.
+ * In ISO-DEP mode the PN532 handles the block framing and the CRC_A itself.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "pn532_com.h"
+#include "pn532_target.h"
+
+static const uint8_t ndef_aid[7] = {0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01};
+
+#define NDEF_FILE_CC    0xE103
+#define NDEF_FILE_NDEF  0xE104
+
+static int tgt_add(pn532_tgt_t *tgt, uint8_t state, uint8_t next_state,
+                   const uint8_t *cmd, size_t cmd_len,
+                   const uint8_t *data, size_t data_len, uint16_t sw)
+{
+    pn532_tgt_entry_t *entry;
+    uint8_t *pool;
+
+    if (cmd_len > sizeof(entry->cmd)) return -1;
+    if (!(entry = realloc(tgt->entries, (tgt->nentries + 1) * sizeof(*entry)))) return -1;
+    tgt->entries = entry;
+    if (!(pool = realloc(tgt->pool, tgt->pool_len + data_len + 2))) return -1;
+    tgt->pool = pool;
+
+    entry = &tgt->entries[tgt->nentries++];
+    entry->state = state;
+    entry->next_state = next_state;
+    entry->cmd_len = cmd_len;
+    memcpy(entry->cmd, cmd, cmd_len);
+    entry->resp_len = data_len + 2;
+    entry->resp_off = tgt->pool_len;
+
+    if (data_len) memcpy(&pool[tgt->pool_len], data, data_len);
+    pool[tgt->pool_len + data_len] = sw >> 8;
+    pool[tgt->pool_len + data_len + 1] = sw & 0xFF;
+    tgt->pool_len += data_len + 2;
+    return 0;
+}
+
+static int tgt_add_select_file(pn532_tgt_t *tgt, uint16_t file, uint8_t next_state) {
+    // P2 = 0x0C (no response data) and 0x00 (FCI requested, none returned)
+    uint8_t cmd[7] = {0x00, 0xA4, 0x00, 0x0C, 0x02, file >> 8, file & 0xFF};
+    uint8_t state;
+    int ret;
+
+    for (state = TGT_FILE_APP; state <= TGT_FILE_NDEF; state++) {
+        cmd[3] = 0x0C;
+        if (ret = tgt_add(tgt, state, next_state, cmd, sizeof(cmd), NULL, 0, 0x9000)) return ret;
+        cmd[3] = 0x00;
+        if (ret = tgt_add(tgt, state, next_state, cmd, sizeof(cmd), NULL, 0, 0x9000)) return ret;
+    }
+    return 0;
+}
+
+/* READ BINARY of the whole file, chunked by MLe, starting at offsets 0 and 2 (after NLEN) */
+static int tgt_add_read_file(pn532_tgt_t *tgt, uint8_t state, const uint8_t *file, size_t file_len, size_t start) {
+    uint8_t cmd[5] = {0x00, 0xB0};
+    size_t offset, len;
+    int ret;
+
+    for (offset = start; offset < file_len; offset += len) {
+        len = file_len - offset;
+        if (len > PN532_TGT_MLE) len = PN532_TGT_MLE;
+        cmd[2] = offset >> 8;
+        cmd[3] = offset & 0xFF;
+        cmd[4] = len;
+        if (ret = tgt_add(tgt, state, TGT_FILE_SAME, cmd, sizeof(cmd), &file[offset], len, 0x9000)) return ret;
+        // Readers usually ask for the full MLe even for the last chunk
+        if (len < PN532_TGT_MLE) {
+            cmd[4] = PN532_TGT_MLE;
+            if (ret = tgt_add(tgt, state, TGT_FILE_SAME, cmd, sizeof(cmd), &file[offset], len, 0x9000)) return ret;
+        }
+    }
+    return 0;
+}
+
+/* Build the response table for a read only Type 4 tag holding the NDEF message ndef */
+int pn532_tgt_build(pn532_tgt_t *tgt, const uint8_t *uid, const uint8_t *ndef, size_t ndef_len) {
+    uint8_t select_app[13] = {0x00, 0xA4, 0x04, 0x00, 0x07};
+    uint8_t read_nlen[5] = {0x00, 0xB0, 0x00, 0x00, 0x02};
+    size_t max_size = ndef_len + 2;
+    int ret;
+
+    if (ndef_len > PN532_TGT_NDEF_MAX) return -1;
+
+    memset(tgt, 0, sizeof(*tgt));
+    memcpy(tgt->uid, uid, sizeof(tgt->uid));
+    tgt->budget_us = PN532_TGT_BUDGET_US;
+
+    if (!(tgt->ndef_file = malloc(max_size))) return -1;
+    tgt->ndef_file[0] = ndef_len >> 8;
+    tgt->ndef_file[1] = ndef_len & 0xFF;
+    memcpy(&tgt->ndef_file[2], ndef, ndef_len);
+    tgt->ndef_file_len = max_size;
+
+    // CCLEN, mapping version 2.0, MLe, MLc, NDEF File Control TLV (read only)
+    tgt->cc[0] = 0x00;
+    tgt->cc[1] = sizeof(tgt->cc);
+    tgt->cc[2] = 0x20;
+    tgt->cc[3] = 0x00;
+    tgt->cc[4] = PN532_TGT_MLE;
+    tgt->cc[5] = 0x00;
+    tgt->cc[6] = 0x01;
+    tgt->cc[7] = 0x04;
+    tgt->cc[8] = 0x06;
+    tgt->cc[9] = NDEF_FILE_NDEF >> 8;
+    tgt->cc[10] = NDEF_FILE_NDEF & 0xFF;
+    tgt->cc[11] = max_size >> 8;
+    tgt->cc[12] = max_size & 0xFF;
+    tgt->cc[13] = 0x00;
+    tgt->cc[14] = 0xFF;
+
+    // SELECT NDEF application, with and without Le
+    memcpy(&select_app[5], ndef_aid, sizeof(ndef_aid));
+    if (ret = tgt_add(tgt, TGT_FILE_ANY, TGT_FILE_APP, select_app, 12, NULL, 0, 0x9000)) goto error;
+    if (ret = tgt_add(tgt, TGT_FILE_ANY, TGT_FILE_APP, select_app, 13, NULL, 0, 0x9000)) goto error;
+
+    if (ret = tgt_add_select_file(tgt, NDEF_FILE_CC, TGT_FILE_CC)) goto error;
+    if (ret = tgt_add_select_file(tgt, NDEF_FILE_NDEF, TGT_FILE_NDEF)) goto error;
+
+    if (ret = tgt_add_read_file(tgt, TGT_FILE_CC, tgt->cc, sizeof(tgt->cc), 0)) goto error;
+    // NLEN only, Le = MLe at offset 0 is the first chunk of the whole file below
+    if (ret = tgt_add(tgt, TGT_FILE_NDEF, TGT_FILE_SAME, read_nlen, sizeof(read_nlen), tgt->ndef_file, 2, 0x9000)) goto error;
+    if (ret = tgt_add_read_file(tgt, TGT_FILE_NDEF, tgt->ndef_file, tgt->ndef_file_len, 2)) goto error;
+    if (ret = tgt_add_read_file(tgt, TGT_FILE_NDEF, tgt->ndef_file, tgt->ndef_file_len, 0)) goto error;
+
+    return 0;
+
+error:
+    pn532_tgt_free(tgt);
+    return ret;
+}
+
+/* Build the response table from the NDEF TLV of an ISO15693 (Type 5) tag image */
+int pn532_tgt_build_hf15(pn532_tgt_t *tgt, const uint8_t *uid, const uint8_t *image, size_t image_len) {
+    size_t pos, len;
+    uint8_t type;
+
+    if (image_len < 4 || (image[0] != 0xE1 && image[0] != 0xE2)) return -1;
+    pos = image[2] ? 4 : 8;     // MLEN 0 means 8 byte CC
+
+    while (pos < image_len) {
+        type = image[pos];
+        if (type == 0x00) {                     // NULL TLV
+            pos++;
+            continue;
+        }
+        if (type == 0xFE) break;                // Terminator TLV
+        if (pos + 2 > image_len) break;
+        if (image[pos + 1] == 0xFF) {
+            if (pos + 4 > image_len) break;
+            len = (image[pos + 2] << 8) | image[pos + 3];
+            pos += 4;
+        } else {
+            len = image[pos + 1];
+            pos += 2;
+        }
+        if (pos + len > image_len) break;
+        if (type == 0x03) return pn532_tgt_build(tgt, uid, &image[pos], len);
+        pos += len;
+    }
+
+    return -1;
+}
+
+void pn532_tgt_free(pn532_tgt_t *tgt) {
+    free(tgt->entries);
+    free(tgt->pool);
+    free(tgt->ndef_file);
+    tgt->entries = NULL;
+    tgt->pool = NULL;
+    tgt->ndef_file = NULL;
+    tgt->nentries = 0;
+    tgt->pool_len = 0;
+    tgt->ndef_file_len = 0;
+}
+
+static const pn532_tgt_entry_t *tgt_lookup(pn532_tgt_t *tgt, const uint8_t *cmd, size_t cmd_len) {
+    const pn532_tgt_entry_t *entry;
+    unsigned int i;
+
+    for (i = 0; i < tgt->nentries; i++) {
+        entry = &tgt->entries[i];
+        if (entry->cmd_len == cmd_len &&
+            (entry->state == TGT_FILE_ANY || entry->state == tgt->file) &&
+            !memcmp(entry->cmd, cmd, cmd_len))
+            return entry;
+    }
+    return NULL;
+}
+
+/* Answer a command that is not in the table, returns the response length */
+static size_t tgt_build_response(pn532_tgt_t *tgt, const uint8_t *cmd, size_t cmd_len, uint8_t *resp) {
+    const uint8_t *file;
+    size_t file_len, offset, len;
+    uint16_t sw = 0x6D00;       // INS not supported
+
+    if (cmd_len >= 2 && cmd[1] == 0xA4) {
+        sw = 0x6A82;            // File or application not found
+        if (cmd_len >= 5 && cmd[2] == 0x04 && cmd[4] == sizeof(ndef_aid) &&
+            cmd_len >= 5 + sizeof(ndef_aid) && !memcmp(&cmd[5], ndef_aid, sizeof(ndef_aid))) {
+            tgt->file = TGT_FILE_APP;
+            sw = 0x9000;
+        } else if (cmd_len >= 7 && cmd[2] == 0x00 && cmd[4] == 2 && tgt->file != TGT_FILE_NONE) {
+            if (((cmd[5] << 8) | cmd[6]) == NDEF_FILE_CC) {
+                tgt->file = TGT_FILE_CC;
+                sw = 0x9000;
+            } else if (((cmd[5] << 8) | cmd[6]) == NDEF_FILE_NDEF) {
+                tgt->file = TGT_FILE_NDEF;
+                sw = 0x9000;
+            }
+        }
+    } else if (cmd_len >= 4 && cmd[1] == 0xB0) {
+        sw = 0x6986;            // Command not allowed, no file selected
+        if (tgt->file == TGT_FILE_CC || tgt->file == TGT_FILE_NDEF) {
+            file = tgt->file == TGT_FILE_CC ? tgt->cc : tgt->ndef_file;
+            file_len = tgt->file == TGT_FILE_CC ? sizeof(tgt->cc) : tgt->ndef_file_len;
+            offset = (cmd[2] << 8) | cmd[3];
+            len = cmd_len >= 5 && cmd[4] ? cmd[4] : PN532_TGT_MLE;
+            if (len > PN532_TGT_MLE) len = PN532_TGT_MLE;
+            if (offset >= file_len) {
+                sw = 0x6B00;    // Wrong offset
+            } else {
+                if (len > file_len - offset) len = file_len - offset;
+                memcpy(resp, &file[offset], len);
+                resp[len] = 0x90;
+                resp[len + 1] = 0x00;
+                return len + 2;
+            }
+        }
+    } else if (cmd_len >= 2 && cmd[1] == 0xD6) {
+        sw = 0x6982;            // Read only
+    }
+
+    resp[0] = sw >> 8;
+    resp[1] = sw & 0xFF;
+    return 2;
+}
+
+static unsigned long elapsed_us(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1000000UL + (end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+/* Configure the PN532 as target and wait until a reader activates it */
+int pn532_tgt_init(pn532_t *pn532, pn532_tgt_t *tgt) {
+    uint8_t cmd[37] = {0};
+    int ret;
+
+    cmd[0] = 0x05;              // Mode: PassiveOnly | PICCOnly
+    cmd[1] = 0x04;              // SENS_RES
+    cmd[2] = 0x00;
+    memcpy(&cmd[3], tgt->uid, sizeof(tgt->uid));
+    cmd[6] = 0x20;              // SEL_RES: ISO14443-4 compliant
+    // FeliCaParams[18], NFCID3t[10], LEN Gt = 0, LEN Tk = 0
+
+    if (ret = pn532_send_command(pn532, TgInitAsTarget, cmd, sizeof(cmd))) return ret;
+    if (ret = pn532_wait_response(pn532, TgInitAsTarget)) return ret;
+    if (pn532->result.len < 1) return 1;
+
+    // Mode, InitiatorCommand (RATS, answered by the PN532)
+    tgt->file = TGT_FILE_NONE;
+    tgt->stats.sessions++;
+    return 0;
+}
+
+/* Answer command APDUs until the reader releases the target
+ * Returns 0 when the reader went away, < 0 on communication errors
+ */
+int pn532_tgt_serve(pn532_t *pn532, pn532_tgt_t *tgt) {
+    const pn532_tgt_entry_t *entry;
+    struct timespec start, end;
+    uint8_t resp[PN532_TGT_MLE + 2];
+    const uint8_t *out;
+    size_t out_len;
+    unsigned long us;
+    int ret;
+
+    for (;;) {
+        if (ret = pn532_send_command(pn532, TgGetData, NULL, 0)) return ret;
+        if (ret = pn532_wait_response(pn532, TgGetData)) return ret;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        // Status, DataIn[]; any error means the reader released or lost the target
+        if (pn532->result.len < 1 || pn532->result.data[0] & 0x3F) return 0;
+
+        if (entry = tgt_lookup(tgt, &pn532->result.data[1], pn532->result.len - 1)) {
+            if (entry->next_state != TGT_FILE_SAME) tgt->file = entry->next_state;
+            out = &tgt->pool[entry->resp_off];
+            out_len = entry->resp_len;
+            tgt->stats.hits++;
+        } else {
+            out_len = tgt_build_response(tgt, &pn532->result.data[1], pn532->result.len - 1, resp);
+            out = resp;
+            tgt->stats.misses++;
+        }
+
+        if (ret = pn532_send_command(pn532, TgSetData, (uint8_t *)out, out_len)) return ret;
+        if (ret = pn532_wait_response(pn532, TgSetData)) return ret;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        us = elapsed_us(&start, &end);
+        tgt->stats.exchanges++;
+        tgt->stats.total_us += us;
+        if (us > tgt->stats.max_us) tgt->stats.max_us = us;
+        if (us > tgt->budget_us) tgt->stats.overruns++;
+
+        if (pn532->result.len < 1 || pn532->result.data[0] & 0x3F) return 0;
+    }
+}
+
+/* Emulate the tag until *stop is set, TgInitAsTarget blocks until a reader shows up
+ * or the response timeout (pn532->timeout_ms, -T of pn532d) hits, then it is sent again
+ */
+int pn532_tgt_run(pn532_t *pn532, pn532_tgt_t *tgt, volatile int *stop) {
+    int ret;
+
+    while (!*stop) {
+        // Reader stays in target mode for the whole session, keep other pn532d clients out
+        if (ret = pn532_lock(pn532)) return ret;
+        ret = pn532_tgt_init(pn532, tgt);
+        if (ret == 0) ret = pn532_tgt_serve(pn532, tgt);
+        else if (ret == TimeoutError && pn532_abort(pn532) == 0) ret = 1;   // No reader yet
+        pn532_unlock(pn532);
+        if (ret < 0) return ret;
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+/* pn532_target.h - Host driven card emulation (NFC Forum Type 4 tag) */
+
+#define PN532_TGT_MLE           0xF0    // Max R-APDU data size announced in the CC file
+#define PN532_TGT_NDEF_MAX      4096    // Max NDEF message size
+#define PN532_TGT_BUDGET_US     5000    // Default turnaround budget TgGetData -> TgSetData done
+
+enum Pn532TgtFile
+{
+    TGT_FILE_NONE,
+    TGT_FILE_APP,           // NDEF application selected
+    TGT_FILE_CC,
+    TGT_FILE_NDEF,
+    TGT_FILE_ANY = 0xFE,    // Entry matches in every state
+    TGT_FILE_SAME = 0xFF    // Entry does not change the state
+};
+
+/* Precomputed response to a command APDU */
+typedef struct
+{
+    uint8_t state;
+    uint8_t next_state;
+    uint8_t cmd_len;
+    uint8_t cmd[16];
+    uint16_t resp_len;
+    uint32_t resp_off;      // Offset into pn532_tgt_t.pool
+} pn532_tgt_entry_t;
+
+typedef struct
+{
+    unsigned long sessions;         // Reader activations
+    unsigned long exchanges;
+    unsigned long hits;             // Answered from the table
+    unsigned long misses;           // Answered by building the response on the fly
+    unsigned long overruns;         // Turnaround above budget_us
+    unsigned long max_us;
+    unsigned long long total_us;
+} pn532_tgt_stats_t;
+
+typedef struct
+{
+    uint8_t uid[3];                 // NFCID1t, the PN532 prepends 0x08
+    uint8_t cc[15];
+    uint8_t *ndef_file;             // NLEN + NDEF message
+    size_t ndef_file_len;
+    pn532_tgt_entry_t *entries;
+    unsigned int nentries;
+    uint8_t *pool;
+    size_t pool_len;
+    uint8_t file;                   // Currently selected file
+    unsigned long budget_us;
+    pn532_tgt_stats_t stats;
+} pn532_tgt_t;
+
+int pn532_tgt_build(pn532_tgt_t *tgt, const uint8_t *uid, const uint8_t *ndef, size_t ndef_len);
+int pn532_tgt_build_hf15(pn532_tgt_t *tgt, const uint8_t *uid, const uint8_t *image, size_t image_len);
+void pn532_tgt_free(pn532_tgt_t *tgt);
+int pn532_tgt_init(pn532_t *pn532, pn532_tgt_t *tgt);
+int pn532_tgt_serve(pn532_t *pn532, pn532_tgt_t *tgt);
+int pn532_tgt_run(pn532_t *pn532, pn532_tgt_t *tgt, volatile int *stop);
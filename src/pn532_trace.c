@@ -0,0 +1,338 @@
+/* pn532_trace.c - Wire trace recording and replay
+ *
+ * pn532_write()/pn532_read() hand every chunk of bytes to pn532_trace_record(),
+ * which appends it to a single producer/single consumer ring without locking
+ * or system calls. A background thread writes the ring to the trace file.
+ * If the ring is full, records are dropped and counted instead of blocking
+ * the caller.
+ *
+ * A trace can be fed back with pn532_replay_open() (pn532_replay_transport),
+ * which makes pn532_read() return the recorded RX bytes, either with the
+ * recorded timing or as fast as possible.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <endian.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "pn532_com.h"
+#include "pn532_trace.h"
+#include "pn532_transport.h"
+
+struct pn532_trace
+{
+    uint8_t *ring;
+    size_t size;                // Power of 2
+    _Atomic size_t head;        // Free running, only written by producer
+    _Atomic size_t tail;        // Free running, only written by flush thread
+    _Atomic int running;
+    _Atomic unsigned long dropped;
+    unsigned long records;
+    unsigned long bytes;
+    uint64_t last_us;
+    FILE *fp;
+    pthread_t thread;
+};
+
+struct pn532_replay
+{
+    uint8_t *buf;
+    size_t len;
+    size_t pos;
+    size_t rx_left;             // Bytes left in current RX record
+    int flags;
+    uint64_t last_us;
+};
+
+static uint64_t mono_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Recording */
+
+static void ring_put(struct pn532_trace *trace, size_t pos, const void *data, size_t len)
+{
+    size_t off = pos & (trace->size - 1), n = trace->size - off;
+
+    if (n > len) n = len;
+    memcpy(trace->ring + off, data, n);
+    if (len > n) memcpy(trace->ring, (const uint8_t *)data + n, len - n);
+}
+
+void pn532_trace_record(struct pn532_trace *trace, uint16_t dir, const uint8_t *data, size_t len)
+{
+    pn532_trace_record_t rec;
+    size_t head, tail, need = sizeof(rec) + len;
+    uint64_t now = mono_us(), delta = now - trace->last_us;
+
+    head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&trace->tail, memory_order_acquire);
+    if (len > PN532_TRACE_LEN_MASK || trace->size - (head - tail) < need) {
+        atomic_fetch_add_explicit(&trace->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    rec.delta_us = htole32(delta > UINT32_MAX ? UINT32_MAX : (uint32_t)delta);
+    rec.dir_len = htole16(dir | (uint16_t)len);
+    ring_put(trace, head, &rec, sizeof(rec));
+    ring_put(trace, head + sizeof(rec), data, len);
+    atomic_store_explicit(&trace->head, head + need, memory_order_release);
+
+    trace->last_us = now;
+    trace->records++;
+    trace->bytes += len;
+}
+
+static void trace_drain(struct pn532_trace *trace)
+{
+    size_t tail, head, off, n;
+
+    tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+    head = atomic_load_explicit(&trace->head, memory_order_acquire);
+    if (head == tail) return;
+
+    off = tail & (trace->size - 1);
+    n = trace->size - off;
+    if (n > head - tail) n = head - tail;
+    fwrite(trace->ring + off, 1, n, trace->fp);
+    if (head - tail > n) fwrite(trace->ring, 1, head - tail - n, trace->fp);
+    fflush(trace->fp);
+
+    atomic_store_explicit(&trace->tail, head, memory_order_release);
+}
+
+static void *trace_thread(void *arg)
+{
+    struct pn532_trace *trace = arg;
+
+    while (atomic_load_explicit(&trace->running, memory_order_relaxed)) {
+        trace_drain(trace);
+        usleep(PN532_TRACE_FLUSH_MS * 1000);
+    }
+
+    return NULL;
+}
+
+/* Start recording all bytes sent and received on pn532 to path
+ * ring_size 0 = PN532_TRACE_RING_SIZE, rounded up to a power of 2
+ */
+int pn532_trace_start(pn532_t *pn532, const char *path, size_t ring_size)
+{
+    struct pn532_trace *trace;
+    pn532_trace_header_t hdr = {PN532_TRACE_MAGIC, htole16(PN532_TRACE_VERSION), 0, 0};
+    struct timespec ts;
+    size_t size = 1024;
+
+    if (pn532->trace) return PAR_ERR;
+    if (!ring_size) ring_size = PN532_TRACE_RING_SIZE;
+    while (size < ring_size) size <<= 1;
+
+    if (!(trace = calloc(1, sizeof(*trace)))) return -1;
+    if (!(trace->ring = malloc(size))) {
+        free(trace);
+        return -1;
+    }
+    trace->size = size;
+
+    if (!(trace->fp = fopen(path, "wb"))) {
+        perror("Unable to create trace file");
+        free(trace->ring);
+        free(trace);
+        return -1;
+    }
+    clock_gettime(CLOCK_REALTIME, &ts);
+    hdr.start_us = htole64((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+    fwrite(&hdr, sizeof(hdr), 1, trace->fp);
+    trace->last_us = mono_us();
+
+    atomic_store(&trace->running, 1);
+    if (pthread_create(&trace->thread, NULL, trace_thread, trace)) {
+        fclose(trace->fp);
+        free(trace->ring);
+        free(trace);
+        return -1;
+    }
+
+    pn532->trace = trace;
+    return 0;
+}
+
+/* Stop recording and write out everything that is still in the ring */
+void pn532_trace_stop(pn532_t *pn532)
+{
+    struct pn532_trace *trace = pn532->trace;
+
+    if (!trace) return;
+    pn532->trace = NULL;
+
+    atomic_store(&trace->running, 0);
+    pthread_join(trace->thread, NULL);
+    trace_drain(trace);
+    fclose(trace->fp);
+    free(trace->ring);
+    free(trace);
+}
+
+void pn532_trace_get_stats(pn532_t *pn532, pn532_trace_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!pn532->trace) return;
+
+    stats->records = pn532->trace->records;
+    stats->bytes = pn532->trace->bytes;
+    stats->dropped = atomic_load_explicit(&pn532->trace->dropped, memory_order_relaxed);
+}
+
+/* Replay */
+
+static int replay_peek(struct pn532_replay *replay, pn532_trace_record_t *rec)
+{
+    if (replay->pos + sizeof(*rec) > replay->len) return -1;
+    memcpy(rec, replay->buf + replay->pos, sizeof(*rec));
+    rec->delta_us = le32toh(rec->delta_us);
+    rec->dir_len = le16toh(rec->dir_len);
+    if (replay->pos + sizeof(*rec) + (rec->dir_len & PN532_TRACE_LEN_MASK) > replay->len) return -1;
+    return 0;
+}
+
+static void replay_pace(struct pn532_replay *replay, uint32_t delta_us)
+{
+    uint64_t now = mono_us(), target = replay->last_us + delta_us;
+
+    if (!(replay->flags & PN532_REPLAY_MAX_SPEED) && now < target) {
+        usleep(target - now);
+        now = mono_us();
+    }
+    replay->last_us = now;
+}
+
+static int replay_open(pn532_t *pn532, const char *path)
+{
+    struct pn532_replay *replay;
+    pn532_trace_header_t hdr;
+    FILE *fp;
+    long size;
+
+    if (!(fp = fopen(path, "rb"))) {
+        perror("Unable to open trace file");
+        return -1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || memcmp(hdr.magic, PN532_TRACE_MAGIC, 4) ||
+        le16toh(hdr.version) != PN532_TRACE_VERSION) {
+        fprintf(stderr, "%s: Not a trace file\n", path);
+        fclose(fp);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp) - sizeof(hdr);
+    fseek(fp, sizeof(hdr), SEEK_SET);
+
+    if (!(replay = calloc(1, sizeof(*replay))) || !(replay->buf = malloc(size ? size : 1))) {
+        free(replay);
+        fclose(fp);
+        return -1;
+    }
+    replay->len = fread(replay->buf, 1, size, fp);
+    replay->last_us = mono_us();
+    fclose(fp);
+
+    pn532->priv = replay;
+    return 0;
+}
+
+/* Open a recorded trace instead of a device, flags PN532_REPLAY_* */
+int pn532_replay_open(pn532_t *pn532, const char *path, int flags)
+{
+    int ret;
+
+    if (ret = pn532_open_transport(pn532, &pn532_replay_transport, path)) return ret;
+    ((struct pn532_replay *)pn532->priv)->flags = flags;
+    return 0;
+}
+
+/* Consume the next TX record
+ * Unread RX data is skipped, just like it would be lost on a real device.
+ * So is a recorded 0x55 wakeup preamble (HSU), which is not sent on replay.
+ */
+static int replay_write(pn532_t *pn532, const uint8_t *data, size_t len)
+{
+    struct pn532_replay *replay = pn532->priv;
+    pn532_trace_record_t rec;
+    size_t rec_len;
+
+    replay->pos += replay->rx_left;
+    replay->rx_left = 0;
+
+    for (;;) {
+        if (replay_peek(replay, &rec)) return -1;
+        rec_len = rec.dir_len & PN532_TRACE_LEN_MASK;
+        if (!(rec.dir_len & PN532_TRACE_RX) &&
+            !(rec_len && replay->buf[replay->pos + sizeof(rec)] == 0x55 && (!len || data[0] != 0x55))) break;
+        replay->pos += sizeof(rec) + rec_len;
+    }
+
+    if ((replay->flags & PN532_REPLAY_STRICT) &&
+        (rec_len != len || memcmp(replay->buf + replay->pos + sizeof(rec), data, len)))
+        return -1;
+
+    replay->pos += sizeof(rec) + rec_len;
+    replay->last_us = mono_us();
+    return 0;
+}
+
+/* Returns recorded RX bytes up to the next TX record */
+static int replay_read(pn532_t *pn532, uint8_t *buffer, size_t len)
+{
+    struct pn532_replay *replay = pn532->priv;
+    pn532_trace_record_t rec;
+    size_t read_bytes = 0, n;
+
+    while (read_bytes < len) {
+        if (!replay->rx_left) {
+            if (replay_peek(replay, &rec) || !(rec.dir_len & PN532_TRACE_RX)) break;
+            replay->pos += sizeof(rec);
+            replay->rx_left = rec.dir_len & PN532_TRACE_LEN_MASK;
+            replay_pace(replay, rec.delta_us);
+        }
+        n = len - read_bytes;
+        if (n > replay->rx_left) n = replay->rx_left;
+        memcpy(buffer + read_bytes, replay->buf + replay->pos, n);
+        replay->pos += n;
+        replay->rx_left -= n;
+        read_bytes += n;
+    }
+
+    return (int)read_bytes;
+}
+
+/* Data is available as long as the next record is RX */
+static int replay_poll(pn532_t *pn532, int timeout_ms)
+{
+    struct pn532_replay *replay = pn532->priv;
+    pn532_trace_record_t rec;
+
+    if (replay->rx_left) return 1;
+    return !replay_peek(replay, &rec) && (rec.dir_len & PN532_TRACE_RX);
+}
+
+static void replay_close(pn532_t *pn532)
+{
+    struct pn532_replay *replay = pn532->priv;
+
+    free(replay->buf);
+    free(replay);
+    pn532->priv = NULL;
+}
+
+const pn532_transport_t pn532_replay_transport =
+{
+    "replay", 0, replay_open, replay_write, replay_read, replay_poll, replay_close
+};
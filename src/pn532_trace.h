@@ -0,0 +1,50 @@
+/* pn532_trace.h - Wire trace recording and replay
+ *
+ * Trace file format (little endian):
+ *   Header:  "PN5T", uint16 version, uint16 reserved, uint64 start time (us since epoch)
+ *   Record:  uint32 time since previous record (us), uint16 dir_len, data[len]
+ *            dir_len bit 15 set = RX (PN532 -> host), bits 0..14 = len
+ */
+
+#define PN532_TRACE_MAGIC       "PN5T"
+#define PN532_TRACE_VERSION     1
+#define PN532_TRACE_RX          0x8000
+#define PN532_TRACE_LEN_MASK    0x7FFF
+
+#define PN532_TRACE_RING_SIZE   (256 * 1024)    // Default ring size
+#define PN532_TRACE_FLUSH_MS    50              // Background flush interval
+
+#define PN532_REPLAY_MAX_SPEED  0x01    // Don't reproduce original timing
+#define PN532_REPLAY_STRICT     0x02    // Fail writes that differ from the recorded TX data
+
+#pragma pack(1)
+
+typedef struct
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t start_us;
+} pn532_trace_header_t;
+
+typedef struct
+{
+    uint32_t delta_us;
+    uint16_t dir_len;
+} pn532_trace_record_t;
+
+#pragma pack()
+
+typedef struct
+{
+    unsigned long records;
+    unsigned long bytes;
+    unsigned long dropped;      // Records lost because the ring was full
+} pn532_trace_stats_t;
+
+int pn532_trace_start(pn532_t *pn532, const char *path, size_t ring_size);
+void pn532_trace_stop(pn532_t *pn532);
+void pn532_trace_get_stats(pn532_t *pn532, pn532_trace_stats_t *stats);
+void pn532_trace_record(struct pn532_trace *trace, uint16_t dir, const uint8_t *data, size_t len);
+
+int pn532_replay_open(pn532_t *pn532, const char *path, int flags);
@@ -0,0 +1,20 @@
+/* pn532_transport.h - Transport backends for pn532_open_transport() */
+
+#define PN532_FRAME_MAX         262     // Preamble + start codes + LEN/LCS + 255 + DCS + postamble
+
+extern const pn532_transport_t pn532_uart_transport;
+extern const pn532_transport_t pn532_spi_transport;
+extern const pn532_transport_t pn532_i2c_transport;
+extern const pn532_transport_t pn532_loop_transport;
+extern const pn532_transport_t pn532_replay_transport;
+
+/* Loopback transport
+ * Everything written is passed to the responder (if set), whatever it returns
+ * is queued to be read. pn532_loop_feed() queues data directly.
+ */
+typedef size_t (*pn532_loop_responder)(void *ctx, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_max);
+
+int pn532_loop_feed(pn532_t *pn532, const uint8_t *data, size_t len);
+int pn532_loop_feed_response(pn532_t *pn532, uint8_t cmd, const uint8_t *data, size_t len);
+void pn532_loop_set_responder(pn532_t *pn532, pn532_loop_responder responder, void *ctx);
+size_t pn532_loop_tx(pn532_t *pn532, uint8_t *buffer, size_t len);
@@ -0,0 +1,98 @@
+/* pn532_uart.c - HSU (serial port) transport */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include "pn532_com.h"
+#include "pn532_transport.h"
+
+#define PN532_SERIAL_SPEED B115200
+
+/* Function to open serial port */
+static int uart_open(pn532_t *pn532, const char *device) {
+    struct termios options;
+    int flags;
+
+    pn532->fd = open(device, O_RDWR | O_NOCTTY);
+    if (pn532->fd == -1) {
+        perror("Unable to open serial port");
+        return -1;
+    }
+
+    tcgetattr(pn532->fd, &options);
+
+    options.c_cflag = CS8 | CLOCAL | CREAD | HUPCL;
+    cfsetispeed(&options, PN532_SERIAL_SPEED);
+    cfsetospeed(&options, PN532_SERIAL_SPEED);
+
+    options.c_iflag = 0;
+    options.c_oflag = 0;
+    options.c_lflag = 0;
+    tcflush(pn532->fd, TCIFLUSH);
+
+    // We do blocking I/O
+    options.c_cc[VMIN] = 1;   // Must read at least 1 byte before returning
+    options.c_cc[VTIME] = 0;  // No timeout (wait indefinitely)
+
+    tcsetattr(pn532->fd, TCSANOW, &options);
+
+    // Set DTR and RTS
+//    flags = TIOCM_DTR;
+//    ioctl(pn532->fd, TIOCMBIS, &flags); // Enable DTR
+    flags = TIOCM_RTS;
+    ioctl(pn532->fd, TIOCMBIS, &flags); // Enable RTS
+
+    // Flush input buffer
+    tcflush(pn532->fd, TCIFLUSH);
+
+    flags = TIOCM_DTR;
+    ioctl(pn532->fd, TIOCMBIC, &flags); // Clear DTR
+    flags = TIOCM_RTS;
+    ioctl(pn532->fd, TIOCMBIC, &flags); // Clear RTS
+
+    usleep(100000);
+
+    tcgetattr(pn532->fd, &options);
+
+    return 0;
+}
+
+static int uart_write(pn532_t *pn532, const uint8_t *data, size_t len) {
+    ssize_t written = write(pn532->fd, data, len);
+    if (written < 0) {
+        perror("Write error");
+        return -1;
+    }
+    return 0;
+}
+
+static int uart_read(pn532_t *pn532, uint8_t *buffer, size_t len) {
+    ssize_t ret = read(pn532->fd, buffer, len);
+    if (ret < 0) {
+        perror("Read error");
+        return -1;
+    }
+    return (int)ret;
+}
+
+static int uart_poll(pn532_t *pn532, int timeout_ms) {
+    struct pollfd pfd = {pn532->fd, POLLIN, 0};
+
+    return poll(&pfd, 1, timeout_ms);
+}
+
+static void uart_close(pn532_t *pn532) {
+    if (pn532->fd != -1) {
+        close(pn532->fd);
+        pn532->fd = -1;
+    }
+}
+
+const pn532_transport_t pn532_uart_transport =
+{
+    "uart", PN532_TR_WAKEUP, uart_open, uart_write, uart_read, uart_poll, uart_close
+};
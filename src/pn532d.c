@@ -0,0 +1,454 @@
+/* pn532d.c - Daemon sharing PN532 readers between multiple client processes
+ *
+ * Usage: pn532d [-s socket] [-t tracefile] [-T timeout_ms] device [device...]
+ *
+ * Every reader is opened once and kept in normal mode. Clients connect via
+ * a Unix domain socket and are linked with pn532_client.c instead of
+ * pn532_com.c/pn532_hf15.c, so they use the same API as before.
+ *
+ * Each reader is served by its own thread. Requests are handled one at a
+ * time and clients with pending requests are served round robin, one request
+ * each, so a client doing a long dump can't starve the others. A client holding
+ * PN532D_LOCK is served exclusively until it unlocks or disconnects.
+ * Responses are waited for at most timeout_ms, then the command is aborted.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include "pn532_com.h"
+#include "pn532_hf15.h"
+#include "pn532_rf.h"
+#include "pn532_trace.h"
+#include "pn532d.h"
+
+#define MAX_READERS     8
+#define MAX_CLIENTS     32
+#define TIMEOUT_MS      5000    // Default for -T
+#define HELLO_TIMEOUT_MS 1000   // Max wait for PN532D_HELLO after connect
+#define PN532_DATA_MAX  253     // Frame LEN covers TFI, command and data
+
+typedef struct
+{
+    int fd;
+    uint8_t *shm;
+} client_t;
+
+typedef struct
+{
+    const char *device;
+    char trace_path[256];
+    pn532_t pn532;
+    int is_open;
+    pthread_t thread;
+    pthread_mutex_t lock;           // Protects clients/nclients
+    client_t clients[MAX_CLIENTS];
+    int nclients;
+    int wake[2];                    // Pipe to notify thread about new clients
+    unsigned int next;              // Round robin position
+    int owner;                      // fd of the client holding PN532D_LOCK, -1 = none
+    unsigned int lock_depth;
+} reader_t;
+
+static reader_t readers[MAX_READERS];
+static int nreaders;
+static int timeout_ms = TIMEOUT_MS;
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+    stop = 1;
+}
+
+static int reader_open(reader_t *reader)
+{
+    int ret;
+
+    if (ret = pn532_open(&reader->pn532, reader->device)) return ret;
+    reader->pn532.timeout_ms = timeout_ms;
+    if (*reader->trace_path) pn532_trace_start(&reader->pn532, reader->trace_path, 0);
+    if (ret = pn532_set_normal_mode(&reader->pn532)) {
+        fprintf(stderr, "%s: %s\n", reader->device, pn532_strerror(ret));
+        pn532_close(&reader->pn532);
+        return ret;
+    }
+    usleep(10000);
+    reader->is_open = 1;
+    return 0;
+}
+
+static void reader_close(reader_t *reader)
+{
+    if (reader->is_open) pn532_close(&reader->pn532);
+    reader->is_open = 0;
+}
+
+/* RFConfiguration goes through pn532_rf.c so the reader's cache stays valid for all clients */
+static int exchange_rfconfig(pn532_t *pn532, uint8_t *d, size_t len, int *ret)
+{
+    if (len < 1) return 0;
+    switch (d[0])
+    {
+    case RfCfgField:        if (len != 2) return 0; *ret = pn532_rf_field(pn532, d[1] & 1, d[1] & 2); break;
+    case RfCfgTimings:      if (len != 4) return 0; *ret = pn532_rf_timings(pn532, d[2], d[3]); break;
+    case RfCfgMaxRtyCOM:    if (len != 2) return 0; *ret = pn532_rf_max_rty_com(pn532, d[1]); break;
+    case RfCfgMaxRetries:   if (len != 4) return 0; *ret = pn532_rf_max_retries(pn532, d[1], d[2], d[3]); break;
+    case RfCfgAnalog106A:   if (len != 1 + sizeof(pn532->rf.analog_106a)) return 0; *ret = pn532_rf_analog_106a(pn532, &d[1]); break;
+    case RfCfgAnalog212_424: if (len != 1 + sizeof(pn532->rf.analog_212_424)) return 0; *ret = pn532_rf_analog_212_424(pn532, &d[1]); break;
+    case RfCfgAnalogTypeB:  if (len != 1 + sizeof(pn532->rf.analog_typeb)) return 0; *ret = pn532_rf_analog_typeb(pn532, &d[1]); break;
+    case RfCfgAnalogISO14443_4: if (len != 1 + sizeof(pn532->rf.analog_iso14443_4)) return 0; *ret = pn532_rf_analog_iso14443_4(pn532, &d[1]); break;
+    default: return 0;
+    }
+
+    if (*ret == 0) {
+        // Answer cached settings like the PN532 would
+        pn532->result.cmd = RFConfiguration;
+        pn532->result.status = SUCCESS;
+        pn532->result.len = 0;
+    }
+    return 1;
+}
+
+static int handle_request(reader_t *reader, client_t *client, pn532d_request_t *req, size_t req_len, pn532d_response_t *resp)
+{
+    pn532_t *pn532 = &reader->pn532;
+    uint8_t *d = req->data;
+    size_t len = req_len - PN532D_REQUEST_HDR;
+    unsigned int count;
+    int ret = PAR_ERR;
+
+    resp->len = 0;
+
+#define NEED(n) if (len < (n)) break
+    switch (req->op)
+    {
+    case PN532D_EXCHANGE:
+        NEED(2);
+        if (len - 2 > PN532_DATA_MAX) break;
+        if (d[0] == RFConfiguration && exchange_rfconfig(pn532, &d[2], len - 2, &ret)) break;
+        if (ret = pn532_send_command(pn532, d[0], &d[2], len - 2)) break;
+        ret = pn532_wait_response(pn532, d[1]);
+        break;
+    case PN532D_IS_PN532KILLER:
+        ret = pn532_is_pn532killer(pn532);
+        break;
+    case PN532D_LOCK:
+        reader->owner = client->fd;
+        reader->lock_depth++;
+        ret = 0;
+        break;
+    case PN532D_UNLOCK:
+        if (reader->owner == client->fd && reader->lock_depth && !--reader->lock_depth) reader->owner = -1;
+        ret = 0;
+        break;
+    case PN532D_HF15_READ_BLOCK:
+        NEED(2);
+        if (d[1] > sizeof(resp->data)) break;
+        // Only succeeds if the block has exactly d[1] bytes, nothing else is copied
+        if ((ret = hf15_read_block(pn532, d[0], resp->data, d[1])) == 0) resp->len = d[1];
+        break;
+    case PN532D_HF15_READ_BLOCKS:
+        NEED(3);
+        if (d[1] * d[2] > sizeof(resp->data)) break;
+        if ((ret = hf15_read_blocks(pn532, d[0], d[1], d[2], resp->data)) == 0) resp->len = d[1] * d[2];
+        break;
+    case PN532D_HF15_DUMP:
+        NEED(4);
+        count = d[1] | d[2] << 8;
+        if (!client->shm || count * d[3] > PN532D_SHM_SIZE) break;
+        ret = hf15_dump(pn532, d[0], count, d[3], client->shm);
+        break;
+    case PN532D_HF15_WRITE_BLOCK:
+        NEED(2);
+        ret = hf15_write_block(pn532, d[0], &d[1], len - 1);
+        break;
+    case PN532D_HF15_WRITE_BLOCK_VERIFY:
+        NEED(2);
+        ret = hf15_write_block_verify(pn532, d[0], &d[1], len - 1);
+        break;
+    case PN532D_HF15_SCAN:
+        ret = hf15_scan(pn532, (hf15_tag_scan *)resp->data);
+        resp->len = sizeof(hf15_tag_scan);
+        break;
+    case PN532D_HF15_INFO:
+        ret = hf15_info(pn532, (hf15_tag_info *)resp->data);
+        resp->len = sizeof(hf15_tag_info);
+        break;
+    case PN532D_HF15_SET_GEN1_UID:
+        NEED(9);
+        ret = hf15_set_gen1_uid(pn532, d, d[8]);
+        break;
+    case PN532D_HF15_SET_GEN2_UID:
+        NEED(8);
+        ret = hf15_set_gen2_uid(pn532, d);
+        break;
+    case PN532D_HF15_SET_GEN2_CONFIG:
+        NEED(4);
+        ret = hf15_set_gen2_config(pn532, d[0], d[1], d[2], d[3]);
+        break;
+    case PN532D_HF15_RAW:
+        NEED(3);
+        ret = hf15_raw(pn532, &d[3], len - 3, d[0], d[1], d[2]);
+        break;
+    case PN532D_HF15_ESET_UID:
+        NEED(9);
+        ret = hf15_eset_uid(pn532, d[0], &d[1]);
+        break;
+    case PN532D_HF15_ESET_BLOCK:
+        NEED(6);
+        ret = hf15_eset_block(pn532, d[0], (int8_t)d[1], &d[2]);
+        break;
+    case PN532D_HF15_ESET_DUMP:
+        NEED(3);
+        count = d[1] | d[2] << 8;
+        if (!client->shm || count > PN532D_SHM_SIZE) break;
+        ret = hf15_eset_dump(pn532, d[0], client->shm, count);
+        break;
+    case PN532D_HF15_ESET_RESV:
+        NEED(5);
+        ret = hf15_eset_resv_eas_afi_dsfid(pn532, d[0], d[1], d[2], d[3], d[4]);
+        break;
+    case PN532D_HF15_ESET_WRITE_PROTECT:
+        NEED(1);
+        ret = hf15_eset_write_protect(pn532, d[0], &d[1], len - 1);
+        break;
+    case PN532D_HF15_ESAVE:
+        NEED(1);
+        ret = hf15_esave(pn532, d[0]);
+        break;
+    default:
+        ret = INVALID_CMD;
+        break;
+    }
+#undef NEED
+
+    return ret;
+}
+
+static void client_remove(reader_t *reader, int i)
+{
+    client_t *client = &reader->clients[i];
+
+    if (reader->owner == client->fd) {
+        reader->owner = -1;
+        reader->lock_depth = 0;
+    }
+    close(client->fd);
+    if (client->shm) munmap(client->shm, PN532D_SHM_SIZE);
+    pthread_mutex_lock(&reader->lock);
+    memmove(client, client + 1, (reader->nclients - i - 1) * sizeof(*client));
+    reader->nclients--;
+    pthread_mutex_unlock(&reader->lock);
+}
+
+/* Serve one request of a client, returns -1 if the client is gone */
+static int client_serve(reader_t *reader, client_t *client)
+{
+    pn532d_request_t req;
+    pn532d_response_t resp;
+    ssize_t n;
+
+    if ((n = recv(client->fd, &req, sizeof(req), 0)) < (ssize_t)PN532D_REQUEST_HDR) return -1;
+
+    if (!reader->is_open && reader_open(reader)) {
+        memset(&resp, 0, PN532D_RESPONSE_HDR);
+        resp.ret = -1;
+    } else {
+        resp.ret = handle_request(reader, client, &req, n, &resp);
+        // Timeout or broken frame, make sure the PN532 is not still busy with the command
+        if (resp.ret < 0) pn532_abort(&reader->pn532);
+        resp.result = reader->pn532.result;
+        resp.rf = reader->pn532.rf;
+    }
+
+    if (send(client->fd, &resp, PN532D_RESPONSE_HDR + resp.len, MSG_NOSIGNAL) < 0) return -1;
+    return 0;
+}
+
+static void *reader_thread(void *arg)
+{
+    reader_t *reader = arg;
+    struct pollfd pfd[MAX_CLIENTS + 1];
+    int gone[MAX_CLIENTS];
+    char buf[16];
+    int i, j, n;
+
+    while (!stop) {
+        pthread_mutex_lock(&reader->lock);
+        n = reader->nclients;
+        pfd[0].fd = reader->wake[0];
+        pfd[0].events = POLLIN;
+        for (i = 0; i < n; i++) {
+            // Only the owner while the reader is locked
+            pfd[i + 1].fd = reader->owner == -1 || reader->owner == reader->clients[i].fd ? reader->clients[i].fd : -1;
+            pfd[i + 1].events = POLLIN;
+            gone[i] = 0;
+        }
+        pthread_mutex_unlock(&reader->lock);
+
+        if (poll(pfd, n + 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (pfd[0].revents & POLLIN) read(reader->wake[0], buf, sizeof(buf));
+
+        // One request per ready client, starting after the client served first last time
+        if (n) reader->next %= n;
+        for (j = 0; j < n; j++) {
+            i = (reader->next + j) % n;
+            if (!pfd[i + 1].revents) continue;
+            if (client_serve(reader, &reader->clients[i])) gone[i] = 1;
+            // Locked by this request, the others have to wait
+            if (reader->owner != -1) break;
+        }
+        reader->next++;
+
+        // Remove disconnected clients back to front, so indices stay valid
+        for (i = n - 1; i >= 0; i--)
+            if (gone[i]) client_remove(reader, i);
+    }
+
+    return NULL;
+}
+
+/* Receive PN532D_HELLO with optional shared memory fd and hand the client to its reader */
+static void client_accept(int fd)
+{
+    pn532d_request_t req;
+    pn532d_response_t resp;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {&req, sizeof(req)};
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+    struct pollfd pfd = {fd, POLLIN};
+    reader_t *reader = &readers[0];
+    uint8_t *shm = NULL;
+    int shm_fd = -1, i;
+    ssize_t n;
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    // Don't let a silent client hold up accepting the others
+    if (poll(&pfd, 1, HELLO_TIMEOUT_MS) <= 0 ||
+        (n = recvmsg(fd, &msg, MSG_DONTWAIT)) < (ssize_t)PN532D_REQUEST_HDR || req.op != PN532D_HELLO) {
+        close(fd);
+        return;
+    }
+    if ((cmsg = CMSG_FIRSTHDR(&msg)) && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        memcpy(&shm_fd, CMSG_DATA(cmsg), sizeof(int));
+        shm = mmap(NULL, PN532D_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+        if (shm == MAP_FAILED) shm = NULL;
+        close(shm_fd);
+    }
+
+    // Unknown device names get the first reader, so tools work unchanged
+    req.data[n - PN532D_REQUEST_HDR < PN532D_MAX_DATA ? n - PN532D_REQUEST_HDR : PN532D_MAX_DATA - 1] = 0;
+    for (i = 0; i < nreaders; i++) {
+        if (!strcmp((char *)req.data, readers[i].device)) reader = &readers[i];
+    }
+
+    memset(&resp, 0, PN532D_RESPONSE_HDR);
+    pthread_mutex_lock(&reader->lock);
+    if (reader->nclients >= MAX_CLIENTS) resp.ret = -1;
+    else {
+        reader->clients[reader->nclients].fd = fd;
+        reader->clients[reader->nclients].shm = shm;
+        reader->nclients++;
+    }
+    pthread_mutex_unlock(&reader->lock);
+
+    send(fd, &resp, PN532D_RESPONSE_HDR, MSG_NOSIGNAL);
+    if (resp.ret) {
+        if (shm) munmap(shm, PN532D_SHM_SIZE);
+        close(fd);
+        return;
+    }
+    write(reader->wake[1], "", 1);
+}
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "Usage: %s [-s socket] [-t tracefile] [-T timeout_ms] device [device...]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *socket_path = getenv("PN532D_SOCKET");
+    const char *trace = NULL;
+    struct sockaddr_un addr = {AF_UNIX};
+    struct sigaction sa = {0};
+    int opt, sock, fd, i;
+
+    if (!socket_path) socket_path = PN532D_SOCKET;
+    while ((opt = getopt(argc, argv, "s:t:T:")) != -1) {
+        switch (opt)
+        {
+        case 's': socket_path = optarg; break;
+        case 't': trace = optarg; break;
+        case 'T': timeout_ms = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc || argc - optind > MAX_READERS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (i = optind; i < argc; i++, nreaders++) {
+        reader_t *reader = &readers[nreaders];
+
+        reader->device = argv[i];
+        reader->owner = -1;
+        if (trace) {
+            if (argc - optind > 1) snprintf(reader->trace_path, sizeof(reader->trace_path), "%s.%d", trace, nreaders);
+            else snprintf(reader->trace_path, sizeof(reader->trace_path), "%s", trace);
+        }
+        pthread_mutex_init(&reader->lock, NULL);
+        if (pipe(reader->wake)) return 1;
+        if (reader_open(reader)) fprintf(stderr, "%s: Unable to open, retrying on first request\n", reader->device);
+    }
+
+    if ((sock = socket(AF_UNIX, SOCK_SEQPACKET, 0)) < 0) {
+        perror("socket");
+        return 1;
+    }
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+    unlink(socket_path);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) || listen(sock, 16)) {
+        perror(socket_path);
+        return 1;
+    }
+
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    for (i = 0; i < nreaders; i++) pthread_create(&readers[i].thread, NULL, reader_thread, &readers[i]);
+
+    while (!stop) {
+        if ((fd = accept(sock, NULL, NULL)) < 0) continue;
+        client_accept(fd);
+    }
+
+    close(sock);
+    unlink(socket_path);
+    for (i = 0; i < nreaders; i++) {
+        write(readers[i].wake[1], "", 1);
+        pthread_join(readers[i].thread, NULL);
+        while (readers[i].nclients) client_remove(&readers[i], readers[i].nclients - 1);
+        reader_close(&readers[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+/* pn532d.h - Protocol between pn532d and pn532_client.c
+ *
+ * Messages are exchanged over a SOCK_SEQPACKET Unix domain socket, one request
+ * is answered by exactly one response. The first request must be PN532D_HELLO,
+ * which selects the reader and may pass a shared memory file descriptor
+ * (SCM_RIGHTS, PN532D_SHM_SIZE bytes) used for bulk data (hf15_dump,
+ * hf15_eset_dump).
+ *
+ * PN532D_LOCK pins the reader to the client until PN532D_UNLOCK (nested) or
+ * until it disconnects, requests of other clients wait in the meantime.
+ */
+
+#define PN532D_SOCKET       "/tmp/pn532d.sock"  // Default, override with $PN532D_SOCKET
+#define PN532D_MAX_DATA     512
+#define PN532D_SHM_SIZE     (64 * 1024)
+
+enum Pn532dOp
+{
+    PN532D_HELLO = 0x01,                // device name, empty = first reader
+    PN532D_EXCHANGE = 0x02,             // cmd, wait_cmd, data[] (max 253): pn532_send_command + pn532_wait_response
+    PN532D_IS_PN532KILLER = 0x03,
+    PN532D_LOCK = 0x04,
+    PN532D_UNLOCK = 0x05,
+
+    PN532D_HF15_READ_BLOCK = 0x10,      // block_num, len
+    PN532D_HF15_READ_BLOCKS = 0x11,     // first_block, count, block_size
+    PN532D_HF15_DUMP = 0x12,            // first_block, count (16 bit LE), block_size; data returned in shm
+    PN532D_HF15_WRITE_BLOCK = 0x13,     // block_num, data[]
+    PN532D_HF15_WRITE_BLOCK_VERIFY = 0x14,
+    PN532D_HF15_SCAN = 0x15,
+    PN532D_HF15_INFO = 0x16,
+    PN532D_HF15_SET_GEN1_UID = 0x17,    // uid[8], block_size
+    PN532D_HF15_SET_GEN2_UID = 0x18,    // uid[8]
+    PN532D_HF15_SET_GEN2_CONFIG = 0x19, // size, adi, dsfid, ic_reference
+    PN532D_HF15_RAW = 0x1A,             // select_tag, append_crc, no_check_response, data[]
+    PN532D_HF15_ESET_UID = 0x1B,        // slot, uid[8]
+    PN532D_HF15_ESET_BLOCK = 0x1C,      // slot, block_index, data[4]
+    PN532D_HF15_ESET_DUMP = 0x1D,       // slot, len (16 bit LE); data passed in shm
+    PN532D_HF15_ESET_RESV = 0x1E,       // slot, resv, eas, afi, dsfid
+    PN532D_HF15_ESET_WRITE_PROTECT = 0x1F, // slot, data[]
+    PN532D_HF15_ESAVE = 0x20            // slot
+};
+
+typedef struct
+{
+    uint16_t op;
+    uint16_t len;
+    uint8_t data[PN532D_MAX_DATA];
+} pn532d_request_t;
+
+typedef struct
+{
+    int32_t ret;
+    uint16_t len;
+    pn532_result_t result;      // pn532->result of the reader after the request
+    pn532_rfcfg_t rf;           // RFConfiguration cache of the reader
+    uint8_t data[PN532D_MAX_DATA];
+} pn532d_response_t;
+
+#define PN532D_REQUEST_HDR      offsetof(pn532d_request_t, data)
+#define PN532D_RESPONSE_HDR     offsetof(pn532d_response_t, data)